@@ -1,6 +1,7 @@
 #pragma once
 
 #include <limits>
+#include <cstring>
 #include <entity/codec.hpp>
 
 
@@ -10,6 +11,8 @@ namespace ent
 	{
 		using codec::item;
 		using codec::object;
+		using codec::object_start;
+		using codec::array_start;
 
 		static_assert(sizeof(int) == 4 && sizeof(long long) == 8 && sizeof(double) == 8, "Sizes of fundamental types are incompatible");
 		static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Not supported on big-endian systems");
@@ -21,7 +24,7 @@ namespace ent
 			End			= 0x00,		Double		= 0x01,		String	= 0x02,		Object		= 0x03, 	Array	= 0x04,	// Supported
 			Binary		= 0x05,		Boolean		= 0x08,		Null	= 0x0a,		Int32		= 0x10,		Int64	= 0x12,
 			ObjectId	= 0x07,		UTC			= 0x09,		RegEx	= 0x0b,		Javascript	= 0x0d,		JsScope	= 0x0f,	// Unsupported
-			Timestamp	= 0x11,		MinKey		= 0xff,		MaxKey	= 0x7f
+			Timestamp	= 0x11,		Decimal		= 0x13,		MinKey	= 0xff,		MaxKey		= 0x7f
 		};
 
 
@@ -133,23 +136,124 @@ namespace ent
 		void write(os &dst, double value) const		{ dst.write((char *)&value, 8); }
 
 
-		virtual bool validate(const string &) const
+		// Walks the entire document in a single pass checking that every embedded length, terminator
+		// and element fits within both the buffer and its enclosing document, so that a malformed or
+		// truncated input is rejected before any decoding takes place. Documents nested more deeply
+		// than max_depth are rejected since decoding them into a tree recurses.
+		virtual bool validate(const string &data) const
 		{
+			int i = 0;
+			std::vector<int> ends = { document(data, i, data.size()) };	// End positions of the enclosing documents
+
+			while (!ends.empty())
+			{
+				const int end		= ends.back();
+				const uint8_t type	= i < end ? data[i++] : error("unterminated document", i);
+
+				if (type == End)
+				{
+					if (i != end) error("invalid document length", i);
+
+					ends.pop_back();
+					continue;
+				}
+
+				terminated(data, i, end);	// Element name
+
+				switch (type)
+				{
+					case Object:
+					case Array:			ends.push_back(document(data, i, end));
+										if ((int)ends.size() > max_depth) error("maximum depth exceeded", i);
+										break;
+					case String:
+					case Javascript:	if (data[bounded(data, i, 1, end) - 1]) error("unterminated string", i - 1);	break;
+					case Binary:		bounded(data, i, 0, end, 1);						break;
+					case JsScope:		bounded(data, i, 14, end, 0, 4);					break;
+					case RegEx:			terminated(data, i, end); terminated(data, i, end);	break;
+					case Boolean:		fixed(i, 1, end);									break;
+					case Int32:			fixed(i, 4, end);									break;
+					case Int64:
+					case Double:
+					case UTC:
+					case Timestamp:		fixed(i, 8, end);									break;
+					case ObjectId:		fixed(i, 12, end);									break;
+					case Decimal:		fixed(i, 16, end);									break;
+					case Null:
+					case MinKey:
+					case MaxKey:															break;
+					default:			error("unknown element type", i - 1);				break;
+				}
+			}
+
 			return true;
 		}
 
 
-		inline uint8_t *increment(const string &s, int &i, int amount) const
+		// Read the length of an embedded document, check that it fits within the enclosing document
+		// and return the position of its end
+		inline int document(const string &s, int &i, int end) const
+		{
+			const int start		= i;
+			const int length	= int32(s, i);
+
+			return length >= 5 && length <= end - start ? start + length : error("invalid document length", start);
+		}
+
+		// Check that a fixed size value fits within the enclosing document and skip it
+		inline void fixed(int &i, int size, int end) const
+		{
+			if (size > end - i) error("insufficient data for value", i);
+			i += size;
+		}
+
+		// Read a length-prefixed value and check that it fits within the enclosing document. The
+		// overhead is the number of bytes following the length that it does not account for, whereas
+		// included is the number of bytes of the length itself that it does account for.
+		inline int bounded(const string &s, int &i, int minimum, int end, int overhead = 0, int included = 0) const
 		{
+			const int start		= i;
+			const int length	= int32(s, i);
+
+			if (length < minimum || length - included > end - i - overhead) error("invalid value length", start);
+
+			i += length - included + overhead;
+			return i;
+		}
+
+		// Check that a cstring is terminated before the end of the enclosing document and skip it
+		inline void terminated(const string &s, int &i, int end) const
+		{
+			const char *start	= s.data() + i;
+			const char *found	= (const char *)std::memchr(start, 0, end - i);
+
+			i = found ? i + (found - start) + 1 : error("unterminated cstring", i);
+		}
+
+
+		// All increments are checked against the buffer so that a corrupt length, even if validation
+		// has been skipped, results in an exception rather than a read beyond the end of the data.
+		// The amount is 64-bit so that adjusting a 32-bit length read from the data cannot overflow.
+		inline uint8_t *increment(const string &s, int &i, int64_t amount) const
+		{
+			if (amount < 0 || amount > (int64_t)s.size() - i) error("invalid length", i);
+
 			uint8_t *result = (uint8_t *)s.data() + i;
-			i += amount;
+			i += (int)amount;
+			return result;
+		}
+
+		template <typename T> inline T read(const string &s, int &i) const
+		{
+			T result;
+			std::memcpy(&result, increment(s, i, sizeof(T)), sizeof(T));
 			return result;
 		}
 
 		inline uint8_t next(const string &s, int &i) const		{ return i < (int)s.size() ? s[i++] : error("could not read byte", i); }
-		inline int32_t int32(const string &s, int &i) const		{ return i < (int)s.size() - 3 ? *(int32_t *)increment(s, i, 4) : error("could not read 32-bit integer", i); }
-		inline int64_t int64(const string &s, int &i) const		{ return i < (int)s.size() - 7 ? *(int64_t *)increment(s, i, 8) : error("could not read 64-bit integer", i); }
-		inline double floating(const string &s, int &i) const	{ return i < (int)s.size() - 7 ? *(double *)increment(s, i, 8)  : error("could not read floating-point value", i); }
+		inline int32_t int32(const string &s, int &i) const		{ return i < (int)s.size() - 3 ? read<int32_t>(s, i)	: error("could not read 32-bit integer", i); }
+		inline int64_t int64(const string &s, int &i) const		{ return i < (int)s.size() - 7 ? read<int64_t>(s, i)	: error("could not read 64-bit integer", i); }
+		inline double floating(const string &s, int &i) const	{ return i < (int)s.size() - 7 ? read<double>(s, i)		: error("could not read floating-point value", i); }
 
 		inline string cstring(const string &s, int &i) const
 		{
@@ -164,21 +268,22 @@ namespace ent
 
 		inline string sstring(const string &s, int &i) const
 		{
-			int length = int32(s, i);
+			const int length = int32(s, i);
 
-			return i + length <= (int)s.size()
+			return length > 0 && length <= (int)s.size() - i
 				? string((char *)increment(s, i, length), length-1)
 				: std::to_string(error("could not read string", i));
 		}
 
 		inline vector<uint8_t> binary(const string &s, int &i) const
 		{
-			int length 		= int32(s, i);
-			uint8_t *end 	= (uint8_t *)s.data() + i + 1 + length;
+			const int length = int32(s, i);
+
+			if (length < 0 || length >= (int)s.size() - i || next(s, i) > 0) error("could not read binary data", i);
 
-			if (i + length >= (int)s.size() || next(s, i) > 0) error("could not read binary data", i);
+			const uint8_t *start = increment(s, i, length);
 
-			return vector<uint8_t>(increment(s, i, length), end);
+			return vector<uint8_t>(start, start + length);
 		}
 
 
@@ -186,14 +291,21 @@ namespace ent
 		{
 			if (type < 0 || type == Object)
 			{
-				return i + int32(data, i) <= (int)data.size() || error("invalid object document length", i);
+				const int start		= i;
+				const int length	= int32(data, i);
+
+				if (length < 5 || length > (int)data.size() - start) error("invalid object document length", start);
+				if (this->depth >= max_depth) error("maximum depth exceeded", start);
+
+				this->depth++;
+				return true;
 			}
 			return false;
 		}
 
 
-		virtual bool object_end(const string &, int &) const	{ return true; }
-		virtual bool array_end(const string &, int &) const		{ return true; }
+		virtual bool object_end(const string &, int &) const	{ this->depth--; return true; }
+		virtual bool array_end(const string &, int &) const		{ this->depth--; return true; }
 
 		virtual bool item(const string &data, int &i, string &name, int &type) const
 		{
@@ -213,7 +325,14 @@ namespace ent
 		{
 			if (type == Array)
 			{
-				return i + int32(data, i) <= (int)data.size() || error("invalid array document length", i);
+				const int start		= i;
+				const int length	= int32(data, i);
+
+				if (length < 5 || length > (int)data.size() - start) error("invalid array document length", start);
+				if (this->depth >= max_depth) error("maximum depth exceeded", start);
+
+				this->depth++;
+				return true;
 			}
 			return false;
 		}
@@ -236,10 +355,10 @@ namespace ent
 		{
 			switch (type)
 			{
-				case String:	increment(data, i, int32(data, i) - 4);	break;
-				case Object:	increment(data, i, int32(data, i) - 4);	break;
-				case Array:		increment(data, i, int32(data, i) - 4);	break;
-				case Binary:	increment(data, i, int32(data, i) - 4);	break;
+				case String:	increment(data, i, int32(data, i));		break;
+				case Object:	increment(data, i, (int64_t)int32(data, i) - 4);	break;
+				case Array:		increment(data, i, (int64_t)int32(data, i) - 4);	break;
+				case Binary:	increment(data, i, (int64_t)int32(data, i) + 1);	break;
 				case Boolean:	increment(data, i, 1);					break;
 				case Int32:		increment(data, i, 4);					break;
 				case Int64:		increment(data, i, 8);					break;
@@ -250,9 +369,10 @@ namespace ent
 				case UTC:			increment(data, i, 8);					break;
 				case Timestamp:		increment(data, i, 8);					break;
 				case ObjectId:		increment(data, i, 12);					break;
+				case Decimal:		increment(data, i, 16);					break;
 				case RegEx:			cstring(data, i); cstring(data, i);		break;
-				case JsScope:		increment(data, i, int32(data, i) - 4);	break;
-				case Javascript:	increment(data, i, int32(data, i) - 4);	break;
+				case JsScope:		increment(data, i, (int64_t)int32(data, i) - 4);	break;
+				case Javascript:	increment(data, i, int32(data, i));		break;
 				default:			break;
 			}
 
@@ -277,9 +397,10 @@ namespace ent
 				case UTC:			increment(data, i, 8);					break;
 				case Timestamp:		increment(data, i, 8);					break;
 				case ObjectId:		increment(data, i, 12);					break;
+				case Decimal:		increment(data, i, 16);					break;
 				case RegEx:			cstring(data, i); cstring(data, i);		break;
-				case JsScope:		increment(data, i, int32(data, i) - 4);	break;
-				case Javascript:	increment(data, i, int32(data, i) - 4);	break;
+				case JsScope:		increment(data, i, (int64_t)int32(data, i) - 4);	break;
+				case Javascript:	increment(data, i, int32(data, i));		break;
 				default:			break;
 			}
 
@@ -299,5 +420,10 @@ namespace ent
 		{
 			throw std::runtime_error("Error parsing bson (" + message +") at byte " + std::to_string(i));
 		}
+
+
+		// Decoding: the number of open documents, which validation cannot bound when it is skipped.
+		// An instance should therefore not be shared between concurrent decode operations.
+		mutable int depth = 0;
 	};
 }
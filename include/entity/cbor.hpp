@@ -0,0 +1,517 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <entity/codec.hpp>
+
+
+namespace ent
+{
+	// CBOR codec (RFC 8949)
+	// Maps and arrays are always encoded with indefinite lengths so that nothing needs to be
+	// known in advance or back-patched, but both definite and indefinite lengths (including
+	// chunked strings) are supported when decoding and tags are ignored. Since item names are
+	// written as map keys the codec must know whether it is currently within a map or an array,
+	// and when decoding it must know how many elements remain in each container, therefore an
+	// instance should not be shared between concurrent encode/decode operations.
+	struct cbor : codec
+	{
+		using codec::item;
+		using codec::object;
+		using codec::object_start;
+		using codec::array_start;
+
+		static_assert(sizeof(float) == 4 && sizeof(double) == 8, "Sizes of fundamental types are incompatible");
+		static const std::ios_base::openmode oflags = std::ios::out | std::ios::binary;
+
+		enum Major : uint8_t
+		{
+			Unsigned	= 0x00,		Negative	= 0x20,		Bytes	= 0x40,		Text	= 0x60,
+			Array		= 0x80,		Map			= 0xa0,		Tag		= 0xc0,		Simple	= 0xe0
+		};
+
+		enum Type : uint8_t
+		{
+			False		= 0xf4,		True		= 0xf5,		Null	= 0xf6,		Undefined	= 0xf7,
+			Half		= 0xf9,		Single		= 0xfa,		Double	= 0xfb,		Break		= 0xff
+		};
+
+		static constexpr uint8_t Indefinite = 0x1f;	// Additional information for indefinite lengths
+
+
+		virtual void object_start(os &dst, const string &name, stack<int> &) const
+		{
+			key(dst, name).put((char)(Map | Indefinite));
+			this->containers.push(true);
+		}
+
+		virtual void array_start(os &dst, const string &name, stack<int> &) const
+		{
+			key(dst, name).put((char)(Array | Indefinite));
+			this->containers.push(false);
+		}
+
+		virtual void object_end(os &dst, stack<int> &) const	{ dst.put((char)Break); this->containers.pop(); }
+		virtual void array_end(os &dst, stack<int> &) const		{ dst.put((char)Break); this->containers.pop(); }
+
+
+		virtual void item(os &dst, const string &name, int) const				{ key(dst, name).put((char)Null); }
+		virtual void item(os &dst, const string &name, bool value, int) const	{ key(dst, name).put((char)(value ? True : False)); }
+		virtual void item(os &dst, const string &name, int32_t value, int) const	{ integer(key(dst, name), value); }
+		virtual void item(os &dst, const string &name, int64_t value, int) const	{ integer(key(dst, name), value); }
+
+		virtual void item(os &dst, const string &name, double value, int) const
+		{
+			// Use the smallest floating point representation that holds the value exactly
+			const uint16_t half = to_half(value);
+
+			if (std::isnan(value) || half_to_double(half) == value)	write(key(dst, name).put((char)Half), half);
+			else if ((double)(float)value == value)					write(key(dst, name).put((char)Single), (float)value);
+			else													write(key(dst, name).put((char)Double), value);
+		}
+
+		virtual void item(os &dst, const string &name, const string &value, int) const
+		{
+			header(key(dst, name), Text, value.size()).write(value.data(), value.size());
+		}
+
+		virtual void item(os &dst, const string &name, const vector<uint8_t> &value, int) const
+		{
+			header(key(dst, name), Bytes, value.size()).write((char *)value.data(), value.size());
+		}
+
+
+		// Write the item name as a map key, unless this is an array item. At the top-level a
+		// name is only written if provided.
+		inline os &key(os &dst, const string &name) const
+		{
+			if (this->containers.empty() ? !name.empty() : this->containers.top())
+			{
+				header(dst, Text, name.size()).write(name.data(), name.size());
+			}
+
+			return dst;
+		}
+
+		// Write the initial byte of a data item followed by the smallest argument that holds the value
+		inline os &header(os &dst, uint8_t major, uint64_t value) const
+		{
+			if (value < 24)				dst.put(major | value);
+			else if (value <= 0xff)		dst.put(major | 24).put(value);
+			else if (value <= 0xffff)	write(dst.put(major | 25), (uint16_t)value);
+			else if (value <= 0xffffffff)	write(dst.put(major | 26), (uint32_t)value);
+			else						write(dst.put(major | 27), value);
+
+			return dst;
+		}
+
+		inline void integer(os &dst, int64_t value) const
+		{
+			// Negative integers are stored as -1 - n so the full range of int64 fits in the argument
+			if (value >= 0)	header(dst, Unsigned, value);
+			else			header(dst, Negative, -1 - value);
+		}
+
+		// All multi-byte values are big-endian
+		template <typename T> inline void write(std::ostream &dst, T value) const
+		{
+			char buffer[sizeof(T)];
+			std::memcpy(buffer, &value, sizeof(T));
+
+			if constexpr (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+			{
+				std::reverse(buffer, buffer + sizeof(T));
+			}
+
+			dst.write(buffer, sizeof(T));
+		}
+
+
+		// Convert to the nearest half-precision value by truncation, the caller must check
+		// that the conversion was exact.
+		static inline uint16_t to_half(double value)
+		{
+			if (std::isnan(value))	return 0x7e00;
+
+			const uint16_t sign	= std::signbit(value) ? 0x8000 : 0;
+			const double a		= std::fabs(value);
+
+			if (std::isinf(a) || a >= 65520.0)	return sign | 0x7c00;	// Infinity, or too large so not exact
+			if (a < std::ldexp(1.0, -14))		return sign | (uint16_t)(a * std::ldexp(1.0, 24));	// Subnormal
+
+			int exponent;
+			const double mantissa = std::frexp(a, &exponent);	// a = mantissa * 2^exponent, mantissa in [0.5, 1)
+
+			return sign | (uint16_t)((exponent + 14) << 10) | ((uint16_t)(mantissa * 2048.0) & 0x3ff);
+		}
+
+		// As described in RFC 8949 appendix D
+		static inline double half_to_double(uint16_t half)
+		{
+			const int exponent	= (half >> 10) & 0x1f;
+			const int mantissa	= half & 0x3ff;
+			const double value	= exponent == 0		? std::ldexp(mantissa, -24)
+								: exponent != 31	? std::ldexp(mantissa + 1024, exponent - 25)
+								: mantissa == 0		? std::numeric_limits<double>::infinity()
+													: std::numeric_limits<double>::quiet_NaN();
+
+			return half & 0x8000 ? -value : value;
+		}
+
+
+		// Validation is a full skip of the top-level value, every read is bounds checked
+		virtual bool validate(const string &data) const
+		{
+			int i = 0;
+			skip(data, i, -1);
+
+			return true;
+		}
+
+
+		virtual bool object_start(const string &data, int &i, int type) const
+		{
+			return start(data, i, type, Map);
+		}
+
+
+		virtual bool object_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool item(const string &data, int &i, string &name, int &type) const
+		{
+			if (more(data, i))
+			{
+				const int key = next(data, i);
+
+				if (major(key) == Text)										name = get(data, i, key, string());
+				else if (major(key) == Unsigned || major(key) == Negative)	name = std::to_string(get(data, i, key, int64_t()));
+				else														name = string("", skip(data, i, key));
+
+				type = next(data, i);
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual bool array_start(const string &data, int &i, int type) const
+		{
+			return start(data, i, type, Array);
+		}
+
+
+		virtual bool array_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool array_item(const string &data, int &i, int &type) const
+		{
+			if (more(data, i))
+			{
+				type = next(data, i);
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual int64_t remaining_items() const
+		{
+			return this->remaining.empty() ? -1 : this->remaining.top();
+		}
+
+
+		virtual int skip(const string &data, int &i, int type) const
+		{
+			return skip(data, i, type, this->remaining.size());
+		}
+
+
+		int skip(const string &data, int &i, int type, int depth) const
+		{
+			if (type < 0)
+			{
+				type = next(data, i);
+			}
+
+			switch (major(type))
+			{
+				case Unsigned:
+				case Negative:	argument(data, i, type);	break;
+
+				case Bytes:
+				case Text:		chunks(data, i, type, [&](int size) { increment(data, i, size); });	break;
+
+				case Array:
+				case Map:
+					if (depth >= max_depth) error("maximum depth exceeded", i);
+
+					if (indefinite(type))
+					{
+						while (!end(data, i))
+						{
+							skip(data, i, -1, depth + 1);
+						}
+					}
+					else
+					{
+						for (uint64_t j = 0, n = argument(data, i, type) * (major(type) == Map ? 2 : 1); j < n; j++)
+						{
+							skip(data, i, -1, depth + 1);
+						}
+					}
+					break;
+
+				default:
+					if (type == Break) error("unexpected break", i);
+
+					argument(data, i, type);	// Simple values and floats are skipped the same way
+					break;
+			}
+
+			return 0;
+		}
+
+
+		virtual tree item(const string &data, int &i, int type) const
+		{
+			switch (major(type))
+			{
+				case Unsigned:
+				case Negative:	return this->get(data, i, type, int64_t());
+				case Bytes:		return this->get(data, i, type, vector<uint8_t>());
+				case Text:		return this->get(data, i, type, string());
+				case Array:		return this->array(data, i, type);
+				case Map:		return this->object(data, i, type);
+			}
+
+			switch (type)
+			{
+				case False:		return false;
+				case True:		return true;
+				case Null:
+				case Undefined:	return nullptr;
+				case Half:
+				case Single:
+				case Double:	return this->get(data, i, type, double());
+			}
+
+			skip(data, i, type);	// Unsupported simple values
+			return {};
+		}
+
+
+		virtual bool get(const string &data, int &i, int type, bool) const				{ return type == True || type == False ? type == True : skip(data, i, type); }
+		virtual int32_t get(const string &data, int &i, int type, int32_t) const		{ return (int32_t)get(data, i, type, int64_t()); }
+		virtual int64_t get(const string &data, int &i, int type, int64_t) const
+		{
+			if (major(type) == Unsigned)	return argument(data, i, type);
+			if (major(type) == Negative)	return -1 - (int64_t)argument(data, i, type);
+
+			return skip(data, i, type);
+		}
+
+		virtual double get(const string &data, int &i, int type, double) const
+		{
+			switch (type)
+			{
+				case Half:		return half_to_double(read<uint16_t>(data, i));
+				case Single:	return read<float>(data, i);
+				case Double:	return read<double>(data, i);
+			}
+
+			if (major(type) == Unsigned || major(type) == Negative)	return get(data, i, type, int64_t());
+
+			return skip(data, i, type);
+		}
+
+		virtual string get(const string &data, int &i, int type, const string) const
+		{
+			string result;
+
+			if (major(type) == Text)
+			{
+				chunks(data, i, type, [&](int size) { result.append((char *)increment(data, i, size), size); });
+			}
+			else skip(data, i, type);
+
+			return result;
+		}
+
+		virtual vector<uint8_t> get(const string &data, int &i, int type, const vector<uint8_t>) const
+		{
+			vector<uint8_t> result;
+
+			if (major(type) == Bytes)
+			{
+				chunks(data, i, type, [&](int size) {
+					const uint8_t *start = increment(data, i, size);
+					result.insert(result.end(), start, start + size);
+				});
+			}
+			else skip(data, i, type);
+
+			return result;
+		}
+
+		virtual bool is_null(const string &, int, int type) const	{ return type == Null || type == Undefined; }
+
+
+		static inline uint8_t major(int type)		{ return type & 0xe0; }
+		static inline bool indefinite(int type)	{ return (type & 0x1f) == Indefinite; }
+
+
+		// Common implementation of object_start and array_start, if the type is not known then
+		// the next byte is only consumed if it is the expected container.
+		inline bool start(const string &data, int &i, int type, uint8_t expected) const
+		{
+			if (type < 0)
+			{
+				int position = i;
+
+				if (i >= (int)data.size() || major(type = next(data, position)) != expected) return false;
+
+				i = position;
+			}
+
+			if (major(type) == expected)
+			{
+				if ((int)this->remaining.size() >= max_depth) error("maximum depth exceeded", i);
+
+				this->remaining.push(indefinite(type) ? -1 : (int64_t)std::min<uint64_t>(argument(data, i, type), std::numeric_limits<int64_t>::max()));
+				return true;
+			}
+
+			return false;
+		}
+
+		// Whether the current container has more elements, consuming the break of an indefinite container
+		inline bool more(const string &data, int &i) const
+		{
+			auto &count = this->remaining.top();
+
+			if (count < 0)	return !end(data, i);
+			if (count > 0)	return count--;
+
+			return false;
+		}
+
+		// Check for (and consume) the break that terminates an indefinite length item
+		inline bool end(const string &data, int &i) const
+		{
+			if (i >= (int)data.size()) error("missing break", i);
+			if ((uint8_t)data[i] == Break)
+			{
+				i++;
+				return true;
+			}
+
+			return false;
+		}
+
+		// Invoke the reader with the size of each chunk in a byte or text string. Definite length
+		// strings consist of a single chunk.
+		template <typename R> inline void chunks(const string &data, int &i, int type, R reader) const
+		{
+			if (indefinite(type))
+			{
+				while (!end(data, i))
+				{
+					const int chunk = next(data, i);
+
+					if (major(chunk) != major(type) || indefinite(chunk)) error("invalid string chunk", i);
+
+					reader(length(data, i, chunk));
+				}
+			}
+			else reader(length(data, i, type));
+		}
+
+		// Length in bytes of a definite length byte or text string
+		inline int length(const string &data, int &i, int type) const
+		{
+			const uint64_t size = argument(data, i, type);
+			return size <= (uint64_t)std::numeric_limits<int>::max() ? size : error("invalid length", i);
+		}
+
+		// Read the argument that follows the initial byte, for simple values this is the
+		// payload (which is only meaningful for floats)
+		inline uint64_t argument(const string &data, int &i, int type) const
+		{
+			switch (type & 0x1f)
+			{
+				case 24:	return read<uint8_t>(data, i);
+				case 25:	return read<uint16_t>(data, i);
+				case 26:	return read<uint32_t>(data, i);
+				case 27:	return read<uint64_t>(data, i);
+				case 28:
+				case 29:
+				case 30:
+				case 31:	return error("invalid argument", i);
+				default:	return type & 0x1f;
+			}
+		}
+
+
+		inline uint8_t *increment(const string &s, int &i, int amount) const
+		{
+			if (amount < 0 || amount > (int)s.size() - i) error("insufficient data", i);
+
+			uint8_t *result = (uint8_t *)s.data() + i;
+			i += amount;
+			return result;
+		}
+
+		// Read the initial byte of the next data item, skipping any tags
+		inline uint8_t next(const string &s, int &i) const
+		{
+			uint8_t result = i < (int)s.size() ? s[i++] : error("could not read byte", i);
+
+			while (major(result) == Tag)
+			{
+				argument(s, i, result);
+				result = i < (int)s.size() ? s[i++] : error("could not read byte", i);
+			}
+
+			return result;
+		}
+
+		template <typename T> inline T read(const string &s, int &i) const
+		{
+			char buffer[sizeof(T)];
+			T result;
+
+			std::memcpy(buffer, increment(s, i, sizeof(T)), sizeof(T));
+
+			if constexpr (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+			{
+				std::reverse(buffer, buffer + sizeof(T));
+			}
+
+			std::memcpy(&result, buffer, sizeof(T));
+			return result;
+		}
+
+
+		int error(const string message, int i) const
+		{
+			throw std::runtime_error("Error parsing cbor (" + message +") at byte " + std::to_string(i));
+		}
+
+
+		mutable stack<bool> containers;		// Encoding: whether each open container is a map (true) or an array (false)
+		mutable stack<int64_t> remaining;	// Decoding: the number of elements yet to be read from each open container (-1 if indefinite)
+	};
+}
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <map>
 #include <stack>
+#include <algorithm>
+#include <memory>
 #include <sstream>
+#include <typeinfo>
+#include <typeindex>
+#include <unordered_map>
 #include <entity/tree.hpp>
 // #include <entity/utilities.hpp>
 
@@ -16,6 +22,14 @@ namespace ent
 	typedef std::istringstream is;
 
 
+	// State used by codecs that preserve the identity of shared pointers (see tracked.hpp)
+	struct references
+	{
+		std::map<std::pair<const void *, std::type_index>, int> ids;								// Identifier assigned to each object (by address and type) when encoding
+		std::unordered_map<int, std::pair<std::shared_ptr<void>, const std::type_info *>> objects;	// Object created for each identifier when decoding
+	};
+
+
 	struct codec
 	{
 		static const std::ios_base::openmode oflags = std::ios::out;
@@ -27,6 +41,19 @@ namespace ent
 		virtual void object_end(os &dst, stack<int> &stack) const = 0;
 		virtual void array_start(os &dst, const string &name, stack<int> &stack) const = 0;
 		virtual void array_end(os &dst, stack<int> &stack) const = 0;
+
+		// Codecs that must know the number of elements up front (such as msgpack) can override
+		// these, by default the element count is ignored
+		virtual void object_start(os &dst, const string &name, stack<int> &stack, [[maybe_unused]] int size) const	{ this->object_start(dst, name, stack); }
+		virtual void array_start(os &dst, const string &name, stack<int> &stack, [[maybe_unused]] int size) const	{ this->array_start(dst, name, stack); }
+
+		// Codecs that omit field names return true, in which case entities are written as arrays
+		// of their fields in mapping order
+		virtual bool positional() const { return false; }
+
+		// Codecs that preserve the identity of shared pointers return the state used to track them
+		virtual references *tracker() const { return nullptr; }
+
 		virtual void item(os &dst, const string &name, int depth) const = 0;	// Array items have 0 length name
 		virtual void item(os &dst, const string &name, bool value, int depth) const = 0;
 		virtual void item(os &dst, const string &name, int32_t value, int depth) const = 0;
@@ -49,6 +76,11 @@ namespace ent
 		virtual bool array_item(const string &data, int &i, int &type) const = 0;
 		virtual int skip(const string &data, int &i, int type) const = 0;
 
+		// Codecs that prefix containers with the number of items they hold (such as msgpack)
+		// return the number that remain to be read in the most recently started container so
+		// that it can be sized up front, by default the count is unknown (-1)
+		virtual int64_t remaining_items() const { return -1; }
+
 		virtual bool get(const string &data, int &i, int type, bool def) const = 0;
 		virtual int32_t get(const string &data, int &i, int type, int32_t def) const = 0;
 		virtual int64_t get(const string &data, int &i, int type, int64_t def) const = 0;
@@ -59,6 +91,18 @@ namespace ent
 		// peak whether or not the next value is null
 		virtual bool is_null(const string &data, int i, int type) const = 0;
 
+		// Binary decoders reject objects and arrays nested more deeply than this, so that corrupt
+		// or malicious input cannot exhaust the stack by recursion.
+		static constexpr int max_depth = 512;
+
+		// The number of items in the container that has just been started, or -1 if unknown.
+		// Every item occupies at least one byte, so the count is limited by the data remaining
+		// to prevent a corrupt or malicious count from exhausting memory.
+		int64_t size_hint(const string &data, int i) const
+		{
+			return std::min<int64_t>(this->remaining_items(), (int64_t)data.size() - i);
+		}
+
 		// To avoid ambiguity and retain positive values cast unsigned integers to 64-bit longs
 		uint32_t get(const string &data, int &i, int type, uint32_t def) const { return this->get(data, i, type, (int64_t)def); }
 
@@ -68,7 +112,7 @@ namespace ent
 		{
 			int i = item.children.size() - 1;
 
-			this->object_start(dst, name, stack);
+			this->object_start(dst, name, stack, item.children.size());
 
 			for (auto &child : item.children)
 			{
@@ -86,7 +130,7 @@ namespace ent
 			int i		= array.size() - 1;
 			int j		= 0;
 
-			this->array_start(dst, name, stack);
+			this->array_start(dst, name, stack, array.size());
 
 			for (auto &child : array)
 			{
@@ -152,6 +196,8 @@ namespace ent
 
 			if (this->array_start(data, i, type))
 			{
+				if (const auto size = this->size_hint(data, i); size > 0) result.reserve(size);
+
 				while (this->array_item(data, i, type))
 				{
 					result.push_back(this->item(data, i, type));
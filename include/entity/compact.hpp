@@ -0,0 +1,427 @@
+#pragma once
+
+#include <limits>
+#include <cstring>
+#include <entity/entity.hpp>
+
+
+namespace ent
+{
+	// Compact binary codec
+	// Entities are written positionally as arrays of their fields in mapping order so that field
+	// names are never stored, integers are zigzag varints and strings/binary are length-prefixed.
+	// Every value retains a single type byte so that data can still be skipped or decoded to a tree.
+	// Since positions replace names, the reader must use the same entity description as the writer,
+	// the fingerprint helpers below can be used to detect a mismatch. Maps and trees are still
+	// written with keys. As with msgpack, element counts are required so an instance should not be
+	// shared between concurrent encode/decode operations.
+	struct compact : codec
+	{
+		using codec::item;
+		using codec::object;
+		using codec::object_start;
+		using codec::array_start;
+
+		static_assert(sizeof(float) == 4 && sizeof(double) == 8, "Sizes of fundamental types are incompatible");
+		static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Compact codec is only supported on little-endian systems");
+		static const std::ios_base::openmode oflags = std::ios::out | std::ios::binary;
+
+		enum Type : uint8_t
+		{
+			Null, False, True, Integer, Float32, Float64, String, Binary, Array, Object,
+			Schema = 0x0f
+		};
+
+
+		virtual bool positional() const { return true; }
+
+
+		virtual void object_start(os &, const string &, stack<int> &) const
+		{
+			throw std::runtime_error("compact codec requires the element count when starting an object");
+		}
+
+		virtual void array_start(os &, const string &, stack<int> &) const
+		{
+			throw std::runtime_error("compact codec requires the element count when starting an array");
+		}
+
+		virtual void object_start(os &dst, const string &name, stack<int> &, int size) const
+		{
+			varint(key(dst, name).put(Object), size);
+			this->containers.push(true);
+		}
+
+		virtual void array_start(os &dst, const string &name, stack<int> &, int size) const
+		{
+			varint(key(dst, name).put(Array), size);
+			this->containers.push(false);
+		}
+
+		virtual void object_end(os &, stack<int> &) const	{ this->containers.pop(); }
+		virtual void array_end(os &, stack<int> &) const	{ this->containers.pop(); }
+
+
+		virtual void item(os &dst, const string &name, int) const				{ key(dst, name).put(Null); }
+		virtual void item(os &dst, const string &name, bool value, int) const	{ key(dst, name).put(value ? True : False); }
+		virtual void item(os &dst, const string &name, int32_t value, int) const	{ varint(key(dst, name).put(Integer), zigzag(value)); }
+		virtual void item(os &dst, const string &name, int64_t value, int) const	{ varint(key(dst, name).put(Integer), zigzag(value)); }
+
+		virtual void item(os &dst, const string &name, double value, int) const
+		{
+			// Single precision is used whenever it can represent the value exactly
+			if ((double)(float)value == value)	write(key(dst, name).put(Float32), (float)value);
+			else								write(key(dst, name).put(Float64), value);
+		}
+
+		virtual void item(os &dst, const string &name, const string &value, int) const
+		{
+			varint(key(dst, name).put(String), value.size()).write(value.data(), value.size());
+		}
+
+		virtual void item(os &dst, const string &name, const vector<uint8_t> &value, int) const
+		{
+			varint(key(dst, name).put(Binary), value.size()).write((char *)value.data(), value.size());
+		}
+
+
+		// Write the item name as a length-prefixed key, unless this is an array item (which includes
+		// the fields of an entity). At the top-level a name is only written if provided.
+		inline os &key(os &dst, const string &name) const
+		{
+			if (this->containers.empty() ? !name.empty() : this->containers.top())
+			{
+				varint(dst, name.size()).write(name.data(), name.size());
+			}
+
+			return dst;
+		}
+
+		static inline std::ostream &varint(std::ostream &dst, uint64_t value)
+		{
+			for (; value >= 0x80; value >>= 7)
+			{
+				dst.put((char)(value | 0x80));
+			}
+
+			return dst.put((char)value);
+		}
+
+		static inline uint64_t zigzag(int64_t value)	{ return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+		static inline int64_t unzigzag(uint64_t value)	{ return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+		template <typename T> static inline void write(std::ostream &dst, T value)
+		{
+			dst.write((char *)&value, sizeof(T));
+		}
+
+
+		// Validation is a full skip of the top-level value, every read is bounds checked
+		virtual bool validate(const string &data) const
+		{
+			int i = 0;
+			skip(data, i, -1);
+
+			return true;
+		}
+
+
+		virtual bool object_start(const string &data, int &i, int type) const
+		{
+			return start(data, i, type, Object);
+		}
+
+
+		virtual bool object_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool item(const string &data, int &i, string &name, int &type) const
+		{
+			if (this->remaining.top() > 0)
+			{
+				this->remaining.top()--;
+
+				const int size	= length(data, i);
+				name			= string((char *)increment(data, i, size), size);
+				type			= next(data, i);
+
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual bool array_start(const string &data, int &i, int type) const
+		{
+			return start(data, i, type, Array);
+		}
+
+
+		virtual bool array_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool array_item(const string &data, int &i, int &type) const
+		{
+			if (this->remaining.top() > 0)
+			{
+				this->remaining.top()--;
+				type = next(data, i);
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual int64_t remaining_items() const
+		{
+			return this->remaining.empty() ? -1 : this->remaining.top();
+		}
+
+
+		virtual int skip(const string &data, int &i, int type) const
+		{
+			return skip(data, i, type, this->remaining.size());
+		}
+
+
+		int skip(const string &data, int &i, int type, int depth) const
+		{
+			if (type < 0)
+			{
+				type = next(data, i);
+			}
+
+			switch (type)
+			{
+				case Null:
+				case False:
+				case True:		break;
+				case Integer:	unsigned_varint(data, i);			break;
+				case Float32:	increment(data, i, 4);				break;
+				case Float64:	increment(data, i, 8);				break;
+				case String:
+				case Binary:	increment(data, i, length(data, i));	break;
+
+				case Array:
+				case Object:
+					if (depth >= max_depth) error("maximum depth exceeded", i);
+
+					for (uint64_t j = 0, n = unsigned_varint(data, i); j < n; j++)
+					{
+						if (type == Object)
+						{
+							increment(data, i, length(data, i));
+						}
+
+						skip(data, i, -1, depth + 1);
+					}
+					break;
+
+				default:		error("unknown type", i);
+			}
+
+			return 0;
+		}
+
+
+		virtual tree item(const string &data, int &i, int type) const
+		{
+			switch (type)
+			{
+				case Null:		return nullptr;
+				case False:		return false;
+				case True:		return true;
+				case Integer:	return this->get(data, i, type, int64_t());
+				case Float32:
+				case Float64:	return this->get(data, i, type, double());
+				case String:	return this->get(data, i, type, string());
+				case Binary:	return this->get(data, i, type, vector<uint8_t>());
+				case Array:		return this->array(data, i, type);
+				case Object:	return this->object(data, i, type);
+				default:		skip(data, i, type);	return {};
+			}
+		}
+
+
+		virtual bool get(const string &data, int &i, int type, bool) const			{ return type == True || type == False ? type == True : skip(data, i, type); }
+		virtual int32_t get(const string &data, int &i, int type, int32_t) const	{ return (int32_t)get(data, i, type, int64_t()); }
+		virtual int64_t get(const string &data, int &i, int type, int64_t) const	{ return type == Integer ? unzigzag(unsigned_varint(data, i)) : skip(data, i, type); }
+
+		virtual double get(const string &data, int &i, int type, double) const
+		{
+			switch (type)
+			{
+				case Float32:	return read<float>(data, i);
+				case Float64:	return read<double>(data, i);
+				case Integer:	return get(data, i, type, int64_t());
+				default:		return skip(data, i, type);
+			}
+		}
+
+		virtual string get(const string &data, int &i, int type, const string) const
+		{
+			if (type == String)
+			{
+				const int size = length(data, i);
+				return string((char *)increment(data, i, size), size);
+			}
+
+			return string("", skip(data, i, type));
+		}
+
+		virtual vector<uint8_t> get(const string &data, int &i, int type, const vector<uint8_t>) const
+		{
+			if (type == Binary)
+			{
+				const int size			= length(data, i);
+				const uint8_t *start	= increment(data, i, size);
+
+				return vector<uint8_t>(start, start + size);
+			}
+
+			return vector<uint8_t>(skip(data, i, type));
+		}
+
+		virtual bool is_null(const string &, int, int type) const	{ return type == Null; }
+
+
+		// Common implementation of object_start and array_start, if the type is not known then
+		// the next byte is only consumed if it is the expected container.
+		inline bool start(const string &data, int &i, int type, uint8_t expected) const
+		{
+			if (type < 0)
+			{
+				if (i >= (int)data.size() || (uint8_t)data[i] != expected) return false;
+
+				type = next(data, i);
+			}
+
+			if (type == expected)
+			{
+				if ((int)this->remaining.size() >= max_depth) error("maximum depth exceeded", i);
+
+				this->remaining.push(std::min<uint64_t>(unsigned_varint(data, i), std::numeric_limits<int64_t>::max()));
+				return true;
+			}
+
+			return false;
+		}
+
+		inline uint64_t unsigned_varint(const string &data, int &i) const
+		{
+			uint64_t result = 0;
+
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				const uint8_t byte = next(data, i);
+				result |= (uint64_t)(byte & 0x7f) << shift;
+
+				if (!(byte & 0x80)) return result;
+			}
+
+			return error("varint is too long", i);
+		}
+
+		// Length in bytes of a string or binary value
+		inline int length(const string &data, int &i) const
+		{
+			const uint64_t size = unsigned_varint(data, i);
+			return size <= (uint64_t)std::numeric_limits<int>::max() ? size : error("invalid length", i);
+		}
+
+		inline uint8_t *increment(const string &s, int &i, int amount) const
+		{
+			if (amount < 0 || amount > (int)s.size() - i) error("insufficient data", i);
+
+			uint8_t *result = (uint8_t *)s.data() + i;
+			i += amount;
+			return result;
+		}
+
+		inline uint8_t next(const string &s, int &i) const
+		{
+			return i < (int)s.size() ? s[i++] : error("could not read byte", i);
+		}
+
+		template <typename T> inline T read(const string &s, int &i) const
+		{
+			T result;
+			std::memcpy(&result, increment(s, i, sizeof(T)), sizeof(T));
+			return result;
+		}
+
+
+		int error(const string message, int i) const
+		{
+			throw std::runtime_error("Error parsing compact (" + message +") at byte " + std::to_string(i));
+		}
+
+
+		// A 64-bit FNV-1a hash of the signature of T, which describes the names and types of its
+		// fields (recursing into child entities and the element types of containers).
+		template <class T> static uint64_t fingerprint()
+		{
+			static const uint64_t result = [] {
+				string signature;
+				uint64_t hash = 0xcbf29ce484222325;
+
+				vref<const T>::type_signature(signature);
+
+				for (auto c : signature)
+				{
+					hash = (hash ^ (uint8_t)c) * 0x100000001b3;
+				}
+
+				return hash;
+			}();
+
+			return result;
+		}
+
+
+		// Encode an entity prefixed with a schema header containing the fingerprint of T
+		template <class T> static string encode(const T &item)
+		{
+			os result(oflags);
+			write(result.put(Schema), fingerprint<T>());
+			result << ent::encode<compact>(item);
+
+			return result.str();
+		}
+
+
+		// Decode an entity that was encoded with a schema header, throwing if the fingerprint
+		// does not match that of T
+		template <class T> static T decode(const string &data, bool skipValidation = false)
+		{
+			const int size	= 1 + sizeof(uint64_t);
+			int i			= 1;
+
+			if ((int)data.size() < size || data[0] != Schema)
+			{
+				throw std::runtime_error("Error parsing compact (missing schema header)");
+			}
+
+			if (compact().read<uint64_t>(data, i) != fingerprint<T>())
+			{
+				throw std::runtime_error("Error parsing compact (schema fingerprint does not match)");
+			}
+
+			return ent::decode<compact, T>(data.substr(size), skipValidation);
+		}
+
+
+		mutable stack<bool> containers;		// Encoding: whether each open container is a map (true) or an array (false)
+		mutable stack<int64_t> remaining;	// Decoding: the number of elements yet to be read from each open container
+	};
+}
@@ -74,6 +74,15 @@ namespace ent
 	}
 
 
+	// Encode an entity, omitting fields according to the options
+	template <class Codec, class T> std::string encode(const T &item, const encoding &options)
+	{
+		encoding::scope scope(options);
+
+		return encode<Codec>(item);
+	}
+
+
 	// Decode an entity
 	template <class Codec, class T> T decode(const std::string &data, T &item, bool skipValidation = false)
 	{
@@ -102,6 +111,47 @@ namespace ent
 	}
 
 
+	// Decode an entity where the objects created are allocated from the memory resource, such as
+	// a std::pmr::monotonic_buffer_resource, so that the entire message can be released at once.
+	// This applies to std::pmr containers and strings within the entity that are empty, and to
+	// the objects created for shared pointers. The resource must outlive the entity, which is
+	// returned by reference since a copy would not use the resource.
+	template <class Codec, class T> T &decode(const std::string &data, T &item, std::pmr::memory_resource *resource, bool skipValidation = false)
+	{
+		static_assert(!std::is_const<T>::value, "Cannot decode to a const entity");
+		static_assert(std::is_base_of<codec, Codec>::value,	"Invalid codec specified");
+
+		Codec c;
+		resource::scope scope(resource);
+
+		if (skipValidation || c.validate(data))
+		{
+			vref<T>::decode(item, c, data, 0, -1);
+		}
+
+		return item;
+	}
+
+
+	// Decode only the fields of an entity selected by the projection, all others are skipped. This
+	// is not an overload of decode since a braced path such as { "name" } would otherwise convert
+	// to the bool skipValidation parameter in preference to a projection.
+	template <class Codec, class T> T decode_fields(const std::string &data, T &item, const projection &fields, bool skipValidation = false)
+	{
+		projection::scope scope(&fields);
+
+		return decode<Codec>(data, item, skipValidation);
+	}
+
+
+	// Decode and create an entity with only the fields selected by the projection
+	template <class Codec, class T> T decode_fields(const std::string &data, const projection &fields, bool skipValidation = false)
+	{
+		T result;
+		return decode_fields<Codec>(data, result, fields, skipValidation);
+	}
+
+
 	// Encode a tree
 	template <class Codec> static std::string encode(const tree &item)
 	{
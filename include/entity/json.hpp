@@ -11,6 +11,8 @@ namespace ent
 	{
 		using codec::item;
 		using codec::object;
+		using codec::object_start;
+		using codec::array_start;
 
 
 		// Array items have 0 length name
@@ -500,6 +502,9 @@ namespace ent
 
 	struct prettyjson : json
 	{
+		using json::object_start;
+		using json::array_start;
+
 		// Array items have 0 length name
 		virtual inline os &write_name(os &dst, const string &name, int depth) const
 		{
@@ -0,0 +1,452 @@
+#pragma once
+
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <entity/codec.hpp>
+
+
+namespace ent
+{
+	// MessagePack codec (https://github.com/msgpack/msgpack/blob/master/spec.md)
+	// Maps and arrays are prefixed with their element count and so this relies upon the sized
+	// object_start/array_start functions. Since item names are written as map keys the codec must
+	// know whether it is currently within a map or an array, and when decoding it must know how
+	// many elements remain in each container, therefore an instance should not be shared between
+	// concurrent encode/decode operations.
+	struct msgpack : codec
+	{
+		using codec::item;
+		using codec::object;
+		using codec::object_start;
+		using codec::array_start;
+
+		static_assert(sizeof(float) == 4 && sizeof(double) == 8, "Sizes of fundamental types are incompatible");
+		static const std::ios_base::openmode oflags = std::ios::out | std::ios::binary;
+
+		enum Type : uint8_t
+		{
+			FixMap	= 0x80,		FixArray	= 0x90,		FixStr	= 0xa0,		NegativeFixInt	= 0xe0,
+			Nil		= 0xc0,		False		= 0xc2,		True	= 0xc3,
+			Bin8	= 0xc4,		Bin16		= 0xc5,		Bin32	= 0xc6,
+			Ext8	= 0xc7,		Ext16		= 0xc8,		Ext32	= 0xc9,
+			Float32	= 0xca,		Float64		= 0xcb,
+			Uint8	= 0xcc,		Uint16		= 0xcd,		Uint32	= 0xce,		Uint64	= 0xcf,
+			Int8	= 0xd0,		Int16		= 0xd1,		Int32	= 0xd2,		Int64	= 0xd3,
+			FixExt1	= 0xd4,		FixExt2		= 0xd5,		FixExt4	= 0xd6,		FixExt8	= 0xd7,		FixExt16	= 0xd8,
+			Str8	= 0xd9,		Str16		= 0xda,		Str32	= 0xdb,
+			Array16	= 0xdc,		Array32		= 0xdd,		Map16	= 0xde,		Map32	= 0xdf
+		};
+
+
+		virtual void object_start(os &, const string &, stack<int> &) const
+		{
+			throw std::runtime_error("msgpack requires the element count when starting an object");
+		}
+
+		virtual void array_start(os &, const string &, stack<int> &) const
+		{
+			throw std::runtime_error("msgpack requires the element count when starting an array");
+		}
+
+		virtual void object_start(os &dst, const string &name, stack<int> &, int size) const
+		{
+			header(key(dst, name), size, FixMap, 0x0f, Map16, Map32);
+			this->containers.push(true);
+		}
+
+		virtual void array_start(os &dst, const string &name, stack<int> &, int size) const
+		{
+			header(key(dst, name), size, FixArray, 0x0f, Array16, Array32);
+			this->containers.push(false);
+		}
+
+		virtual void object_end(os &, stack<int> &) const	{ this->containers.pop(); }
+		virtual void array_end(os &, stack<int> &) const	{ this->containers.pop(); }
+
+
+		virtual void item(os &dst, const string &name, int) const				{ key(dst, name).put((char)Nil); }
+		virtual void item(os &dst, const string &name, bool value, int) const	{ key(dst, name).put((char)(value ? True : False)); }
+		virtual void item(os &dst, const string &name, int32_t value, int) const	{ integer(key(dst, name), value); }
+		virtual void item(os &dst, const string &name, int64_t value, int) const	{ integer(key(dst, name), value); }
+
+		virtual void item(os &dst, const string &name, double value, int) const
+		{
+			// Single precision is used whenever it can represent the value exactly
+			if ((double)(float)value == value)	write(key(dst, name).put((char)Float32), (float)value);
+			else								write(key(dst, name).put((char)Float64), value);
+		}
+
+		virtual void item(os &dst, const string &name, const string &value, int) const
+		{
+			header(key(dst, name), value.size(), FixStr, 0x1f, Str16, Str32, Str8).write(value.data(), value.size());
+		}
+
+		virtual void item(os &dst, const string &name, const vector<uint8_t> &value, int) const
+		{
+			header(key(dst, name), value.size(), Bin8, 0, Bin16, Bin32, Bin8).write((char *)value.data(), value.size());
+		}
+
+
+		// Write the item name as a map key, unless this is an array item. At the top-level a
+		// name is only written if provided.
+		inline os &key(os &dst, const string &name) const
+		{
+			if (this->containers.empty() ? !name.empty() : this->containers.top())
+			{
+				header(dst, name.size(), FixStr, 0x1f, Str16, Str32, Str8).write(name.data(), name.size());
+			}
+
+			return dst;
+		}
+
+		// Write the smallest header that can hold the given size. A fix type stores the size in the
+		// low bits of the header byte (if limit is zero the type has no fix variant).
+		inline os &header(os &dst, size_t size, uint8_t fix, uint8_t limit, uint8_t type16, uint8_t type32, uint8_t type8 = 0) const
+		{
+			if (limit && size <= limit)		dst.put(fix | size);
+			else if (type8 && size <= 0xff)	dst.put(type8).put(size);
+			else if (size <= 0xffff)		write(dst.put(type16), (uint16_t)size);
+			else							write(dst.put(type32), (uint32_t)size);
+
+			return dst;
+		}
+
+		inline void integer(std::ostream &dst, int64_t value) const
+		{
+			if (value >= 0)
+			{
+				if (value <= 0x7f)			dst.put(value);
+				else if (value <= 0xff)		dst.put((char)Uint8).put(value);
+				else if (value <= 0xffff)	write(dst.put((char)Uint16), (uint16_t)value);
+				else if (value <= 0xffffffff)	write(dst.put((char)Uint32), (uint32_t)value);
+				else						write(dst.put((char)Uint64), (uint64_t)value);
+			}
+			else
+			{
+				if (value >= -32)									dst.put(value);
+				else if (value >= std::numeric_limits<int8_t>::min())	dst.put((char)Int8).put(value);
+				else if (value >= std::numeric_limits<int16_t>::min())	write(dst.put((char)Int16), (int16_t)value);
+				else if (value >= std::numeric_limits<int32_t>::min())	write(dst.put((char)Int32), (int32_t)value);
+				else													write(dst.put((char)Int64), value);
+			}
+		}
+
+		// All multi-byte values are big-endian
+		template <typename T> inline void write(std::ostream &dst, T value) const
+		{
+			char buffer[sizeof(T)];
+			std::memcpy(buffer, &value, sizeof(T));
+
+			if constexpr (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+			{
+				std::reverse(buffer, buffer + sizeof(T));
+			}
+
+			dst.write(buffer, sizeof(T));
+		}
+
+
+		// Validation is a full skip of the top-level value, every read is bounds checked
+		virtual bool validate(const string &data) const
+		{
+			int i = 0;
+			skip(data, i, -1);
+
+			return true;
+		}
+
+
+		virtual bool object_start(const string &data, int &i, int type) const
+		{
+			if (type < 0)
+			{
+				if (i >= (int)data.size() || !is_map(data[i])) return false;
+
+				type = next(data, i);
+			}
+
+			if (is_map(type))
+			{
+				if ((int)this->remaining.size() >= max_depth) error("maximum depth exceeded", i);
+
+				this->remaining.push(count(data, i, type));
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual bool object_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool item(const string &data, int &i, string &name, int &type) const
+		{
+			if (this->remaining.top() > 0)
+			{
+				this->remaining.top()--;
+
+				const int key = next(data, i);
+
+				if (is_string(key))			name = get(data, i, key, string());
+				else if (is_integer(key))	name = std::to_string(get(data, i, key, int64_t()));
+				else						name = string("", skip(data, i, key));
+
+				type = next(data, i);
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual bool array_start(const string &data, int &i, int type) const
+		{
+			if (type < 0)
+			{
+				if (i >= (int)data.size() || !is_array(data[i])) return false;
+
+				type = next(data, i);
+			}
+
+			if (is_array(type))
+			{
+				if ((int)this->remaining.size() >= max_depth) error("maximum depth exceeded", i);
+
+				this->remaining.push(count(data, i, type));
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual bool array_end(const string &, int &) const
+		{
+			this->remaining.pop();
+			return true;
+		}
+
+
+		virtual bool array_item(const string &data, int &i, int &type) const
+		{
+			if (this->remaining.top() > 0)
+			{
+				this->remaining.top()--;
+				type = next(data, i);
+				return true;
+			}
+
+			return false;
+		}
+
+
+		virtual int64_t remaining_items() const
+		{
+			return this->remaining.empty() ? -1 : this->remaining.top();
+		}
+
+
+		virtual int skip(const string &data, int &i, int type) const
+		{
+			return skip(data, i, type, this->remaining.size());
+		}
+
+
+		int skip(const string &data, int &i, int type, int depth) const
+		{
+			if (type < 0)
+			{
+				type = next(data, i);
+			}
+
+			if (is_map(type) || is_array(type))
+			{
+				if (depth >= max_depth) error("maximum depth exceeded", i);
+
+				for (int64_t j = 0, n = count(data, i, type) * (is_map(type) ? 2 : 1); j < n; j++)
+				{
+					skip(data, i, -1, depth + 1);
+				}
+			}
+			else if (is_string(type) || is_binary(type))
+			{
+				increment(data, i, length(data, i, type));
+			}
+			else switch (type)
+			{
+				case Uint8:		case Int8:						increment(data, i, 1);	break;
+				case Uint16:	case Int16:						increment(data, i, 2);	break;
+				case Uint32:	case Int32:		case Float32:	increment(data, i, 4);	break;
+				case Uint64:	case Int64:		case Float64:	increment(data, i, 8);	break;
+				case FixExt1:									increment(data, i, 2);	break;
+				case FixExt2:									increment(data, i, 3);	break;
+				case FixExt4:									increment(data, i, 5);	break;
+				case FixExt8:									increment(data, i, 9);	break;
+				case FixExt16:									increment(data, i, 17);	break;
+				case Ext8:										increment(data, i, read<uint8_t>(data, i) + 1);				break;
+				case Ext16:										increment(data, i, read<uint16_t>(data, i) + 1);			break;
+				case Ext32:										increment(data, i, (int64_t)read<uint32_t>(data, i) + 1);	break;
+				default:																break;	// Fix ints, nil and booleans have no payload
+			}
+
+			return 0;
+		}
+
+
+		virtual tree item(const string &data, int &i, int type) const
+		{
+			if (is_map(type))		return this->object(data, i, type);
+			if (is_array(type))		return this->array(data, i, type);
+			if (is_string(type))	return this->get(data, i, type, string());
+			if (is_binary(type))	return this->get(data, i, type, vector<uint8_t>());
+			if (is_integer(type))	return this->get(data, i, type, int64_t());
+			if (is_floating(type))	return this->get(data, i, type, double());
+			if (is_boolean(type))	return type == True;
+			if (type == Nil)		return nullptr;
+
+			skip(data, i, type);	// Unsupported extension types
+			return {};
+		}
+
+
+		virtual bool get(const string &data, int &i, int type, bool) const					{ return is_boolean(type) ? type == True : skip(data, i, type); }
+		virtual int32_t get(const string &data, int &i, int type, int32_t) const			{ return (int32_t)get(data, i, type, int64_t()); }
+		virtual int64_t get(const string &data, int &i, int type, int64_t) const
+		{
+			if (type <= 0x7f)			return type;
+			if (type >= NegativeFixInt)	return (int8_t)type;
+
+			switch (type)
+			{
+				case Uint8:		return read<uint8_t>(data, i);
+				case Uint16:	return read<uint16_t>(data, i);
+				case Uint32:	return read<uint32_t>(data, i);
+				case Uint64:	return read<uint64_t>(data, i);
+				case Int8:		return read<int8_t>(data, i);
+				case Int16:		return read<int16_t>(data, i);
+				case Int32:		return read<int32_t>(data, i);
+				case Int64:		return read<int64_t>(data, i);
+				default:		return skip(data, i, type);
+			}
+		}
+
+		virtual double get(const string &data, int &i, int type, double) const
+		{
+			if (type == Float32)	return read<float>(data, i);
+			if (type == Float64)	return read<double>(data, i);
+			if (is_integer(type))	return get(data, i, type, int64_t());
+
+			return skip(data, i, type);
+		}
+
+		virtual string get(const string &data, int &i, int type, const string) const
+		{
+			if (is_string(type))
+			{
+				const int size = length(data, i, type);
+				return string((char *)increment(data, i, size), size);
+			}
+
+			return string("", skip(data, i, type));
+		}
+
+		virtual vector<uint8_t> get(const string &data, int &i, int type, const vector<uint8_t>) const
+		{
+			if (is_binary(type))
+			{
+				const int size			= length(data, i, type);
+				const uint8_t *start	= increment(data, i, size);
+
+				return vector<uint8_t>(start, start + size);
+			}
+
+			return vector<uint8_t>(skip(data, i, type));
+		}
+
+		virtual bool is_null(const string &, int, int type) const	{ return type == Nil; }
+
+
+		static inline bool is_map(uint8_t type)			{ return (type & 0xf0) == FixMap || type == Map16 || type == Map32; }
+		static inline bool is_array(uint8_t type)		{ return (type & 0xf0) == FixArray || type == Array16 || type == Array32; }
+		static inline bool is_string(uint8_t type)		{ return (type & 0xe0) == FixStr || (type >= Str8 && type <= Str32); }
+		static inline bool is_binary(uint8_t type)		{ return type >= Bin8 && type <= Bin32; }
+		static inline bool is_integer(uint8_t type)		{ return type <= 0x7f || type >= NegativeFixInt || (type >= Uint8 && type <= Int64); }
+		static inline bool is_floating(uint8_t type)	{ return type == Float32 || type == Float64; }
+		static inline bool is_boolean(uint8_t type)		{ return type == True || type == False; }
+
+
+		// Number of elements in a map or array
+		inline int64_t count(const string &data, int &i, int type) const
+		{
+			switch (type)
+			{
+				case Map16:	case Array16:	return read<uint16_t>(data, i);
+				case Map32:	case Array32:	return read<uint32_t>(data, i);
+				default:					return type & 0x0f;
+			}
+		}
+
+		// Length in bytes of a string or binary value
+		inline int length(const string &data, int &i, int type) const
+		{
+			switch (type)
+			{
+				case Str8:	case Bin8:	return read<uint8_t>(data, i);
+				case Str16:	case Bin16:	return read<uint16_t>(data, i);
+				case Str32:	case Bin32:
+				{
+					const uint32_t size = read<uint32_t>(data, i);
+					return size <= (uint32_t)std::numeric_limits<int>::max() ? size : error("invalid length", i);
+				}
+				default:				return type & 0x1f;
+			}
+		}
+
+
+		inline uint8_t *increment(const string &s, int &i, int64_t amount) const
+		{
+			if (amount < 0 || amount > (int64_t)s.size() - i) error("insufficient data", i);
+
+			uint8_t *result = (uint8_t *)s.data() + i;
+			i += amount;
+			return result;
+		}
+
+		inline uint8_t next(const string &s, int &i) const
+		{
+			return i < (int)s.size() ? s[i++] : error("could not read byte", i);
+		}
+
+		template <typename T> inline T read(const string &s, int &i) const
+		{
+			char buffer[sizeof(T)];
+			T result;
+
+			std::memcpy(buffer, increment(s, i, sizeof(T)), sizeof(T));
+
+			if constexpr (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+			{
+				std::reverse(buffer, buffer + sizeof(T));
+			}
+
+			std::memcpy(&result, buffer, sizeof(T));
+			return result;
+		}
+
+
+		int error(const string message, int i) const
+		{
+			throw std::runtime_error("Error parsing msgpack (" + message +") at byte " + std::to_string(i));
+		}
+
+
+		mutable stack<bool> containers;		// Encoding: whether each open container is a map (true) or an array (false)
+		mutable stack<int64_t> remaining;	// Decoding: the number of elements yet to be read from each open container
+	};
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <initializer_list>
+
+
+namespace ent
+{
+	// A set of field paths, such as "header.id", used to restrict decoding to a subset of the
+	// fields of an entity. Every other field is skipped at the codec level. Paths pass straight
+	// through containers, so "samples.value" selects the value field of every entity in the
+	// samples vector (or map). Selecting a field without any children selects it in full.
+	class projection
+	{
+		public:
+
+			projection() {}
+			projection(std::initializer_list<std::string> paths) { for (auto &p : paths) this->add(p); }
+
+
+			projection &add(const std::string &path)
+			{
+				projection *node	= this;
+				size_t begin		= 0;
+
+				while (true)
+				{
+					const size_t end		= path.find('.', begin);
+					auto [field, inserted]	= node->fields.try_emplace(path.substr(begin, end - begin));
+
+					// The field has already been selected in full
+					if (!inserted && field->second.all()) break;
+
+					node = &field->second;
+
+					if (end == std::string::npos)
+					{
+						node->fields.clear();
+						break;
+					}
+
+					begin = end + 1;
+				}
+
+				return *this;
+			}
+
+
+			bool all() const { return this->fields.empty(); }
+
+
+			// Returns nullptr if the field is not part of the projection
+			const projection *field(const std::string &name) const
+			{
+				auto field = this->fields.find(name);
+				return field == this->fields.end() ? nullptr : &field->second;
+			}
+
+
+			// The projection applied to the entity currently being decoded on this thread, which
+			// is nullptr when all fields are decoded.
+			static const projection *&active()
+			{
+				thread_local const projection *current = nullptr;
+				return current;
+			}
+
+
+			// Applies a projection for the lifetime of the scope, restoring the previous one afterwards
+			class scope
+			{
+				public:
+
+					scope(const projection *p) : previous(active())	{ active() = p && !p->all() ? p : nullptr; }
+					~scope()										{ active() = this->previous; }
+
+					scope(const scope &) = delete;
+					scope &operator=(const scope &) = delete;
+
+				private:
+
+					const projection *previous;
+			};
+
+		private:
+
+			std::map<std::string, projection> fields;
+	};
+
+
+	// Options that reduce the size of encoded entities. Both are ignored by positional codecs,
+	// since fields can only be omitted where they are identified by name.
+	struct encoding
+	{
+		projection fields = {};		// If not empty then only the selected fields are encoded
+		bool omit_defaults = false;	// Omit fields equal to the value declared by the entity
+
+
+		// Whether defaults are omitted by the entity currently being encoded on this thread
+		static bool &omitting()
+		{
+			thread_local bool current = false;
+			return current;
+		}
+
+
+		// Applies the options for the lifetime of the scope, restoring the previous ones afterwards
+		class scope
+		{
+			public:
+
+				scope(const encoding &options) : fields(&options.fields), previous(omitting())	{ omitting() = options.omit_defaults; }
+				~scope()																		{ omitting() = this->previous; }
+
+				scope(const scope &) = delete;
+				scope &operator=(const scope &) = delete;
+
+			private:
+
+				projection::scope fields;
+				bool previous;
+		};
+	};
+}
@@ -5,385 +5,338 @@
 #include <list>
 #include <vector>
 #include <memory>
-#include <numeric>
+#include <optional>
 #include <algorithm>
-#include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <entity/query/source.hpp>
+#include <entity/query/stages.hpp>
+#include <entity/query/erased.hpp>
+#include <entity/query/parallel.hpp>
+#include <entity/query/batch.hpp>
+#include <entity/query/kernels.hpp>
+#include <entity/query/explain.hpp>
+#include <entity/query/keyed_index.hpp>
 
 
 namespace ent
 {
-	class qbase
-	{
-		public:
-			virtual ~qbase() {}
+	template <class T, class S = stages::erased<T>> class query;
+
+	template <typename T> struct is_query : std::false_type {};
+	template <typename T, typename S> struct is_query<query<T, S>> : std::true_type {};
 
-		protected:
-			std::shared_ptr<qbase> parent = nullptr;
-			template <class T> friend class query;
-	};
 
+	// The result type of a selector, unless explicitly specified
+	template <class U, class F, class... A> using selected = std::conditional_t<
+		std::is_void_v<U>, std::decay_t<std::invoke_result_t<F, A...>>, U
+	>;
 
-	template <class T> class query : public qbase
+
+	// A lazily evaluated query over a sequence of items. Each operation returns a new query whose
+	// stage type wraps the previous one, so a chain of operations is composed at compile time and
+	// items are pulled through it without any allocation or indirect calls. Function objects are
+	// stored by value and invoked with a const reference to each item. The S parameter defaults
+	// to a type-erased stage so that query<T> can hold any pipeline (and can be implicitly
+	// constructed from containers and initialiser lists).
+	template <class T, class S> class query
 	{
-		public:
+		static constexpr bool is_erased = std::is_same_v<S, stages::erased<T>>;
 
-			// Force the default copy constructor (to avoid getting caught by the templated one below)
-			query(const query<T> &copy) = default;
+		template <class U> using if_erased = std::enable_if_t<is_erased && std::is_same_v<U, U>>;
 
+		public:
 
-			// Construct from initialiser list
-			query(std::initializer_list<T> data) : buffer(std::make_shared<std::vector<T>>(data))
-			{
-				this->setup(*this->buffer);
-			}
+			using value_type = T;
 
+			// Force the default copy constructor (to avoid getting caught by the templated ones below)
+			query(const query &copy) = default;
 
-			// Construct from any container type
-			template <class U, class = typename std::enable_if<std::is_same<T, typename U::value_type>::value>::type> query(U &data)
-			{
-				this->setup(data);
-			}
 
+			// Construct from a pipeline stage
+			explicit query(S stage) : stage(std::move(stage)) {}
 
-			query<T> where(std::function<bool(const T&)> predicate)
-			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) -> T* {
-						auto p = static_cast<query<T>*>(c->parent.get());
 
-						for (T *i = p->start(p, forward); i; i = p->next(p)) if (predicate(*i)) return i;
+			// Construct from initialiser list
+			template <class U = T, class = if_erased<U>> query(std::initializer_list<T> data)
+				: stage(stages::buffer<T>(data)) {}
 
-						return nullptr;
-					},
-					[=](qbase *c) -> T* {
-						auto p = static_cast<query<T>*>(c->parent.get());
 
-						for (T *i = p->next(p); i; i = p->next(p)) if (predicate(*i)) return i;
+			// Construct from any container type
+			template <class U, class = if_erased<U>, class = std::enable_if_t<!is_query<U>::value && std::is_same_v<T, typename U::value_type>>> query(U &data)
+				: stage(stages::container<U>(data)) {}
 
-						return nullptr;
-					}
-				};
-			}
+
+			// Construct from any other query of the same type
+			template <class R, class = if_erased<R>> query(const query<T, R> &other)
+				: stage(other.stage) {}
 
 
-			query<T> take(int count)
+			template <class F> auto where(F predicate) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto p = static_cast<query<T>*>(c->parent.get());
+				return wrap(stages::where<S, F>(this->stage, std::move(predicate)));
+			}
 
-						static_cast<query<T>*>(c)->counter = 1;
 
-						return count > 0 ? p->start(p, forward) : nullptr;
-					},
-					[=](qbase *c) {
-						auto t = static_cast<query<T>*>(c);
-						auto p = static_cast<query<T>*>(c->parent.get());
+			// Following order_by this limits the sort rather than adding a stage, so that only
+			// the items taken are ever fully ordered.
+			auto take(int count) const
+			{
+				if constexpr (is_ordered<S>::value)
+				{
+					const int limit = this->stage.limit();
 
-						return t->counter++ < count ? p->next(p) : nullptr;
-					}
-				};
+					return wrap(stages::order_by<typename S::parent_type, typename S::ordering_type, true>(
+						this->stage.source(), this->stage.ordering(), std::max(0, limit < 0 ? count : std::min(limit, count))
+					));
+				}
+				else return wrap(stages::take<S>(this->stage, count));
 			}
 
 
-			query<T> take_while(std::function<bool(const T&)> predicate)
+			template <class F> auto take_while(F predicate) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto p 	= static_cast<query<T>*>(c->parent.get());
-						T *i	= p->start(p, forward);
+				return wrap(stages::take_while<S, F>(this->stage, std::move(predicate)));
+			}
 
-						return predicate(*i) ? i : nullptr;
-					},
-					[=](qbase *c) {
-						auto p 	= static_cast<query<T>*>(c->parent.get());
-						T *i	= p->next(p);
 
-						return predicate(*i) ? i : nullptr;
-					}
-				};
+			auto skip(int count) const
+			{
+				return wrap(stages::skip<S>(this->stage, count));
 			}
 
 
-			query<T> reverse()
+			template <class F> auto skip_while(F predicate) const
 			{
-				return {
-					*this,
-					[](qbase *c, bool forward) {
-						return static_cast<query<T>*>(c->parent.get())->start(c->parent.get(), !forward);
-					},
-					[](qbase *c) {
-						return static_cast<query<T>*>(c->parent.get())->next(c->parent.get());
-					}
-				};
+				return wrap(stages::skip_while<S, F>(this->stage, std::move(predicate)));
 			}
 
 
-			template <class U> query<U> select(std::function<const U(const T&)> operation)
+			auto reverse() const
 			{
-				return query<U> {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto t	= static_cast<query<U>*>(c);
-						auto p	= static_cast<query<T>*>(c->parent.get());
-						T *i	= p->start(p, forward);
+				return wrap(stages::reverse<S>(this->stage));
+			}
 
-						return i ? &(t->item = operation(*i)) : nullptr;
-					},
-					[=](qbase *c) {
-						auto t	= static_cast<query<U>*>(c);
-						auto p	= static_cast<query<T>*>(c->parent.get());
-						T *i	= p->next(p);
 
-						return i ? &(t->item = operation(*i)) : nullptr;
-					}
-				};
+			// The result type can be specified explicitly, otherwise it is the type returned by the operation
+			template <class U = void, class F> auto select(F operation) const
+			{
+				return wrap(stages::select<S, F, selected<U, F, const T&>>(this->stage, std::move(operation)));
 			}
 
 
-			query<T> distinct()
+			// The hash and equality function objects used by distinct and the other set operations
+			// can be customised, otherwise the item type must be supported by std::hash.
+			template <class H = std::hash<T>, class E = std::equal_to<T>> auto distinct(H hash = H(), E equal = E()) const
 			{
-				return {
-					*this,
-					[](qbase *c, bool forward) {
-						auto t = static_cast<query<T>*>(c);
-						auto p = static_cast<query<T>*>(c->parent.get());
+				return wrap(stages::distinct<S, H, E>(this->stage, std::move(hash), std::move(equal)));
+			}
 
-						t->buffer = std::make_shared<std::vector<T>>();
-						for (T *i = p->start(p, forward); i; i = p->next(p))
-						{
-							if (std::find(t->buffer->begin(), t->buffer->end(), *i) == t->buffer->end())
-							{
-								t->buffer->emplace_back(*i);
-							}
-						}
 
-						t->it = std::make_shared<iterators<typename std::vector<T>::iterator>>(t->buffer->begin(), t->buffer->end());
-						return t->it->next();
-					},
-					[=](qbase *c) {
-						return static_cast<query<T>*>(c)->it->next();
-					}
-				};
+			// The key type can be specified explicitly, otherwise it is the type returned by the selector
+			template <class U = void, class F> auto order_by(F selector, bool descending = false) const
+			{
+				return wrap(stages::order_by<S, ordering<U, F>>(this->stage, { std::move(selector), descending }));
 			}
 
 
-			template <class U> query<T> order_by(std::function<const U(const T&)> selector, bool descending = false)
+			// This is safe to call on any query instance, however it will have no effect on the query
+			// unless it follows an order_by/then_by chain that has not been ended by a take.
+			template <class U = void, class F> auto then_by(F selector, bool descending = false) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto t = static_cast<query<T>*>(c);
-						auto p = static_cast<query<T>*>(c->parent.get());
+				if constexpr (is_ordered<S>::value && !is_limited<S>::value)
+				{
+					using O = compound<typename S::ordering_type, ordering<U, F>>;
+					using P = typename S::parent_type;
 
-						t->buffer = std::make_shared<std::vector<T>>();
-						for (T *i = p->start(p, true); i; i = p->next(p)) t->buffer->emplace_back(*i);
+					return wrap(stages::order_by<P, O>(
+						this->stage.source(), { this->stage.ordering(), { std::move(selector), descending } }, this->stage.limit()
+					));
+				}
+				else return *this;
+			}
 
-						if (descending)
-						{
-							std::stable_sort(t->buffer->begin(), t->buffer->end(), [&](const T &a, const T &b) {
-								return t->comparator && selector(a) == selector(b) ? t->comparator(a, b) : selector(a) > selector(b);
-							});
-						}
-						else
-						{
-							std::stable_sort(t->buffer->begin(), t->buffer->end(), [&](const T &a, const T &b) {
-								return t->comparator && selector(a) == selector(b) ? t->comparator(a, b) : selector(a) < selector(b);
-							});
-						}
 
-						if (forward)	t->it = std::make_shared<iterators<typename std::vector<T>::iterator>>(t->buffer->begin(), t->buffer->end());
-						else			t->it = std::make_shared<iterators<typename std::vector<T>::reverse_iterator>>(t->buffer->rbegin(), t->buffer->rend());
+			template <class R> auto concat(const query<T, R> &src) const	{ return wrap(stages::concat<S, R>(this->stage, src.stage)); }
+			auto concat(const query<T> &src) const							{ return this->concat<stages::erased<T>>(src); }
 
-						return t->it->next();
-					},
-					[=](qbase *c) {
-						return static_cast<query<T>*>(c)->it->next();
-					},
-				};
+			template <class R, class H = std::hash<T>, class E = std::equal_to<T>> auto except(const query<T, R> &src, H hash = H(), E equal = E()) const
+			{
+				return wrap(stages::except<S, R, H, E>(this->stage, src.stage, std::move(hash), std::move(equal)));
 			}
 
-
-			// This uses comparator passing and is therefore safe to call on any query instance, however it will
-			// have no effect on the query unless it follows an order_by/then_by chain.
-			template <class U> query<T> then_by(std::function<const U(const T&)> selector, bool descending = false)
-			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto t = static_cast<query<T>*>(c);
-						auto p = static_cast<query<T>*>(c->parent.get());
-
-						if (t->comparator)
-						{
-							if (descending)	p->comparator = [=](const T &a, const T &b) { return selector(a) == selector(b) ? t->comparator(a, b) : selector(a) > selector(b); };
-							else			p->comparator = [=](const T &a, const T &b) { return selector(a) == selector(b) ? t->comparator(a, b) : selector(a) < selector(b); };
-						}
-						else
-						{
-							if (descending)	p->comparator = [=](const T &a, const T &b) { return selector(a) > selector(b); };
-							else			p->comparator = [=](const T &a, const T &b) { return selector(a) < selector(b); };
-						}
-
-						return p->start(p, forward);
-					},
-					[](qbase *c) {
-						return static_cast<query<T>*>(c->parent.get())->next(c->parent.get());
-					}
-				};
+			template <class H = std::hash<T>, class E = std::equal_to<T>> auto except(const query<T> &src, H hash = H(), E equal = E()) const
+			{
+				return this->except<stages::erased<T>, H, E>(src, std::move(hash), std::move(equal));
 			}
 
 
-			query<T> concat(const query<T> &src)
+			// Returns the distinct items that appear in both sequences
+			template <class R, class H = std::hash<T>, class E = std::equal_to<T>> auto intersect(const query<T, R> &src, H hash = H(), E equal = E()) const
+			{
+				return wrap(stages::intersect<S, R, H, E>(this->stage, src.stage, std::move(hash), std::move(equal)));
+			}
+
+			template <class H = std::hash<T>, class E = std::equal_to<T>> auto intersect(const query<T> &src, H hash = H(), E equal = E()) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto t		= static_cast<query<T>*>(c);
-						t->counter	= forward;
+				return this->intersect<stages::erased<T>, H, E>(src, std::move(hash), std::move(equal));
+			}
 
-						if (forward)	t->queries = { c->parent, std::make_shared<query<T>>(src) };
-						else			t->queries = { std::make_shared<query<T>>(src), c->parent };
 
-						T *i = static_cast<query<T>*>(t->queries.front().get())->start(t->queries.front().get(), forward);
+			// Returns the distinct items that appear in either sequence
+			template <class R, class H = std::hash<T>, class E = std::equal_to<T>> auto union_with(const query<T, R> &src, H hash = H(), E equal = E()) const
+			{
+				return wrap(stages::distinct<stages::concat<S, R>, H, E>({ this->stage, src.stage }, std::move(hash), std::move(equal)));
+			}
 
-						if (!i)
-						{
-							t->queries.pop_front();
-							return static_cast<query<T>*>(t->queries.front().get())->start(t->queries.front().get(), forward);
-						}
+			template <class H = std::hash<T>, class E = std::equal_to<T>> auto union_with(const query<T> &src, H hash = H(), E equal = E()) const
+			{
+				return this->union_with<stages::erased<T>, H, E>(src, std::move(hash), std::move(equal));
+			}
 
-						return i;
-					},
-					[](qbase *c) -> T* {
-						auto t = static_cast<query<T>*>(c);
 
-						if (!t->queries.empty())
-						{
-							T *i = static_cast<query<T>*>(t->queries.front().get())->next(t->queries.front().get());
+			// The result type can be specified explicitly, otherwise it is the type returned by the operation
+			template <class U = void, class V, class R, class F> auto zip(const query<V, R> &src, F operation) const
+			{
+				return wrap(stages::zip<S, R, F, selected<U, F, const T&, const V&>>(this->stage, src.stage, std::move(operation)));
+			}
+
+			template <class U = void, class V, class F> auto zip(const query<V> &src, F operation) const
+			{
+				return this->zip<U, V, stages::erased<V>>(src, std::move(operation));
+			}
 
-							if (!i && t->queries.size() > 1)
-							{
-								t->queries.pop_front();
-								return static_cast<query<T>*>(t->queries.front().get())->start(t->queries.front().get(), t->counter);
-							}
 
-							return i;
-						}
+			// Returns a sequence of grouping items, each holding a key and the items that share it. The key
+			// and element types can be specified explicitly, otherwise they are the types returned by
+			// the selectors.
+			template <class K = void, class F> auto group_by(F key) const
+			{
+				return this->group_by<K, T>(std::move(key), identity());
+			}
 
-						return nullptr;
-					}
-				};
+			template <
+				class K = void, class V = void, class F, class G,
+				class H = std::hash<selected<K, F, const T&>>, class E = std::equal_to<selected<K, F, const T&>>
+			>
+			auto group_by(F key, G element, H hash = H(), E equal = E()) const
+			{
+				return wrap(stages::group_by<S, F, G, selected<K, F, const T&>, selected<V, G, const T&>, H, E>(
+					this->stage, std::move(key), std::move(element), std::move(hash), std::move(equal)
+				));
 			}
 
 
-			query<T> except(const query<T> &data)
+			// Combines each item with every item of the other sequence that has a matching key. The
+			// result type can be specified explicitly, otherwise it is the type returned by the operation.
+			template <
+				class U = void, class V, class R, class F, class G, class O,
+				class K = selected<void, F, const T&>, class H = std::hash<K>, class E = std::equal_to<K>
+			>
+			auto join(const query<V, R> &src, F outer, G inner, O operation, H hash = H(), E equal = E()) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) -> T* {
-						auto p = static_cast<query<T>*>(c->parent.get());
+				return wrap(stages::join<S, R, F, G, O, K, selected<U, O, const T&, const V&>, H, E>(
+					this->stage, src.stage, std::move(outer), std::move(inner), std::move(operation), std::move(hash), std::move(equal)
+				));
+			}
 
-						for (T *i = p->start(p, forward); i; i = p->next(p))
-						{
-							if (std::find(data.begin(), data.end(), *i) == data.end()) return i;
-						}
+			template <
+				class U = void, class V, class F, class G, class O,
+				class K = selected<void, F, const T&>, class H = std::hash<K>, class E = std::equal_to<K>
+			>
+			auto join(const query<V> &src, F outer, G inner, O operation, H hash = H(), E equal = E()) const
+			{
+				return this->join<U, V, stages::erased<V>, F, G, O, K, H, E>(
+					src, std::move(outer), std::move(inner), std::move(operation), std::move(hash), std::move(equal)
+				);
+			}
 
-						return nullptr;
-					},
-					[=](qbase *c) -> T* {
-						auto p = static_cast<query<T>*>(c->parent.get());
 
-						for (T *i = p->next(p); i; i = p->next(p))
-						{
-							if (std::find(data.begin(), data.end(), *i) == data.end()) return i;
-						}
+			// Restrict a source that is sorted by key (a map, set or ent::keyed_index) to the items
+			// with the given key, or with keys in the inclusive range, using a binary search rather
+			// than a scan.
+			template <class K> auto where_key(const K &key) const
+			{
+				return this->where_key_range(key, key);
+			}
 
-						return nullptr;
-					}
-				};
+			template <class K> auto where_key_range(const K &lower, const K &upper) const
+			{
+				return wrap(this->sorted().restrict(lower, upper));
 			}
 
 
-			template<class U, class V> query<U> zip(const query<V> &src, std::function<const U(const T&, const V&)> selector)
+			// Items of a source that is sorted by key are already in key order, so no sort is required
+			auto order_by_key(bool descending = false) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto t		= static_cast<query<U>*>(c);
-						auto p		= static_cast<query<T>*>(c->parent.get());
-						t->queries	= { std::make_shared<query<V>>(src) };
-						T *i		= p->start(p, forward);
-						V *j		= static_cast<query<V>*>(t->queries.front().get())->start(t->queries.front().get(), forward);
+				return wrap(this->sorted().arrange(descending));
+			}
 
-						return i && j ? &(t->item = selector(*i, *j)) : nullptr;
-					},
-					[=](qbase *c) -> U* {
-						auto t	= static_cast<query<U>*>(c);
-						auto p	= static_cast<query<T>*>(c->parent.get());
 
-						if (t->queries.size() == 1)
-						{
-							T *i	= p->next(p);
-							V *j	= static_cast<query<V>*>(t->queries.front().get())->next(t->queries.front().get());
+			auto default_if_empty(const T &value = T()) const
+			{
+				return wrap(stages::default_if_empty<S>(this->stage, value));
+			}
 
-							return i && j ? &(t->item = selector(*i, *j)) : nullptr;
-						}
 
-						return nullptr;
-					}
-				};
+			// Terminal operations on the result are evaluated across multiple threads. This is only
+			// available where the source has random access and is followed solely by where/select
+			// stages, since any other stage depends upon the items before it.
+			auto parallel(int threads = 0) const
+			{
+				return parallel_query<T, S>(this->stage, threads);
 			}
 
 
-			query<T> default_if_empty(const T &defaultValue = T())
+			// Terminal operations on the result are evaluated a block of items at a time, which
+			// is available where the source is followed solely by where/select/take/skip stages.
+			auto batch(size_t size = 1024) const
 			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						T *i = static_cast<query<T>*>(c->parent.get())->start(c->parent.get(), forward);
-						return i ? i : &(static_cast<query<T>*>(c)->item = defaultValue);
-					},
-					[](qbase *c) {
-						return static_cast<query<T>*>(c->parent.get())->next(c->parent.get());
-					}
-				};
+				return batch_query<T, S>(this->stage, size);
 			}
 
 
-			T aggregate(std::function<const T(const T&, const T&)> accumulator)
+			template <class F> T aggregate(F accumulator)
 			{
-				return this->begin() == this->end() ? T() : std::accumulate(++this->begin(), this->end(), *this->begin(), accumulator);
+				T *i = this->stage.start(true);
+
+				if (!i) return T();
+
+				T result = *i;
+
+				for (i = this->stage.next(); i; i = this->stage.next()) result = accumulator(std::as_const(result), std::as_const(*i));
+
+				return result;
 			}
 
 
-			template <class U> U aggregate(const U seed, std::function<const U(const U&, const T&)> accumulator)
+			template <class U, class F> U aggregate(const U seed, F accumulator)
 			{
-				return std::accumulate(this->begin(), this->end(), seed, accumulator);
+				U result = seed;
+
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) result = accumulator(std::as_const(result), std::as_const(*i));
+
+				return result;
 			}
 
 
-			template <class U, class V> V aggregate(const U seed, std::function<const U(const U&, const T&)> accumulator, std::function<const V(const U&)> selector)
+			template <class U, class V = void, class F, class G> auto aggregate(const U seed, F accumulator, G selector)
 			{
-				return selector(std::accumulate(this->begin(), this->end(), seed, accumulator));
+				return selected<V, G, const U&>(selector(this->aggregate<U>(seed, std::move(accumulator))));
 			}
 
 
-			bool all(std::function<bool(const T&)> predicate)
+			template <class F> bool all(F predicate)
 			{
-				for (T *i = start(this, true); i; i = next(this)) if (!predicate(*i)) return false;
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) if (!predicate(std::as_const(*i))) return false;
 
 				return true;
 			}
 
 
-			bool any(std::function<bool(const T&)> predicate)
+			template <class F> bool any(F predicate)
 			{
-				for (T *i = start(this, true); i; i = next(this)) if (predicate(*i)) return true;
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) if (predicate(std::as_const(*i))) return true;
 
 				return false;
 			}
@@ -391,82 +344,110 @@ namespace ent
 
 			bool contains(const T &item)
 			{
-				for (T *i = start(this, true); i; i = next(this)) if (*i == item) return true;
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) if (*i == item) return true;
 
 				return false;
 			}
 
 
-			bool sequence_equal(const query<T> &src)
+			template <class R> bool sequence_equal(const query<T, R> &src)
 			{
-				query<T> s = src;
+				if constexpr (stages::is_sized<S>::value && stages::is_sized<R>::value)
+				{
+					if (this->stage.size() != src.stage.size()) return false;
+				}
+
+				R other	= src.stage;
+				T *i	= this->stage.start(true);
+				T *j	= other.start(true);
 
-				if (s.count() == this->count())
+				for (; i && j; i = this->stage.next(), j = other.next())
 				{
-					for (T *i = start(this, true), *j = s.start(&s, true); i && j; i = next(this), j = s.next(&s))
-					{
-						if (*i != *j) return false;
-					}
+					if (!(*i == *j)) return false;
+				}
+
+				return !i && !j;
+			}
 
-					return true;
+			bool sequence_equal(const query<T> &src) { return this->sequence_equal<stages::erased<T>>(src); }
+
+
+			int count()
+			{
+				if constexpr (stages::is_sized<S>::value)
+				{
+					return this->stage.size();
 				}
+				else
+				{
+					int result = 0;
 
-				return false;
+					for (T *i = this->stage.start(true); i; i = this->stage.next(), result++);
+
+					return result;
+				}
 			}
 
 
-			int count(std::function<bool(const T&)> predicate = nullptr)
+			template <class F> int count(F predicate)
 			{
 				int result = 0;
 
-				if (predicate)
-				{
-					for (T *i = start(this, true); i; i = next(this)) if (predicate(*i)) result++;
-				}
-				else for (T *i = start(this, true); i; i = next(this), result++);
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) if (predicate(std::as_const(*i))) result++;
 
 				return result;
 			}
 
 
-			T element_at(int index)												{ return this->element_at(index, true); }
-			T element_at_or_default(int index)									{ return this->element_at(index, false); }
+			T element_at(int index)											{ return this->element_at(index, true); }
+			T element_at_or_default(int index)								{ return this->element_at(index, false); }
+
+			T first()														{ return this->first_last(nullptr, true, true); }
+			T first_or_default()											{ return this->first_last(nullptr, false, true); }
+			template <class F> T first(F predicate)							{ return this->first_last(predicate, true, true); }
+			template <class F> T first_or_default(F predicate)				{ return this->first_last(predicate, false, true); }
 
-			T first()															{ return this->first_last(nullptr, true, true); }
-			T first_or_default()												{ return this->first_last(nullptr, false, true); }
-			T first(std::function<bool(const T&)> predicate)					{ return this->first_last(predicate, true, true); }
-			T first_or_default(std::function<bool(const T&)> predicate)			{ return this->first_last(predicate, false, true); }
+			T last()														{ return this->first_last(nullptr, true, false); }
+			T last_or_default()												{ return this->first_last(nullptr, false, false); }
+			template <class F> T last(F predicate)							{ return this->first_last(predicate, true, false); }
+			template <class F> T last_or_default(F predicate)				{ return this->first_last(predicate, false, false); }
 
-			T last()															{ return this->first_last(nullptr, true, false); }
-			T last_or_default()													{ return this->first_last(nullptr, false, false); }
-			T last(std::function<bool(const T&)> predicate)						{ return this->first_last(predicate, true, false); }
-			T last_or_default(std::function<bool(const T&)> predicate)			{ return this->first_last(predicate, false, false); }
+			T single() 														{ return this->single(nullptr, true); }
+			T single_or_default()											{ return this->single(nullptr, false); }
+			template <class F> T single(F predicate)						{ return this->single(predicate, true); }
+			template <class F> T single_or_default(F predicate)				{ return this->single(predicate, false); }
 
-			T single() 															{ return this->single(nullptr, true); }
-			T single_or_default()												{ return this->single(nullptr, false); }
-			T single(std::function<bool(const T&)> predicate)					{ return this->single(predicate, true); }
-			T single_or_default(std::function<bool(const T&)> predicate)		{ return this->single(predicate, false); }
+			T min()															{ return this->min_max(identity(), true); }
+			T max()															{ return this->min_max(identity(), false); }
+			T sum()															{ return this->sum<T>(identity()); }
+			double average()												{ return this->average<T>(identity()); }
+			template <class U = void, class F> auto min(F selector)		{ return this->min_max<selected<U, F, const T&>>(selector, true); }
+			template <class U = void, class F> auto max(F selector)		{ return this->min_max<selected<U, F, const T&>>(selector, false); }
 
-			T min()																{ return this->min_max(true); }
-			T max()																{ return this->min_max(false); }
-			T sum()																{ return sum<T>(nullptr); }
-			double average()													{ return average<T>(nullptr); }
-			template <class U> U min(std::function<const U(const T&)> selector)	{ return this->min_max<U>(selector, true); }
-			template <class U> U max(std::function<const U(const T&)> selector)	{ return this->min_max<U>(selector, false); }
 
-			query<T> skip(int count)											{ return this->skip(count, nullptr); }
-			query<T> skip_while(std::function<bool(const T&)> predicate)		{ return this->skip(0, predicate); }
+			// Compensated summation, for floating-point data where the accumulated rounding
+			// error of a simple sum is unacceptable.
+			T stable_sum() { return this->stable_sum<T>(identity()); }
 
 
-			template <class U> double average(std::function<const U(const T&)> selector)
+			// Numeric reductions use the kernels when items can be accessed directly by index,
+			// such as a vector of arithmetic values or a field selected from a vector of entities.
+			template <class U = void, class F> double average(F selector)
 			{
-				static_assert(std::is_arithmetic<U>::value, "query::average is only suitable for arithmetic types");
+				static_assert(std::is_arithmetic_v<selected<U, F, const T&>>, "query::average is only suitable for arithmetic types");
 
 				int count 	= 0;
 				double sum	= 0;
 
-				if (selector) 	for (T *i = start(this, true); i; i = next(this), count++) sum += (double)selector(*i);
-				else			for (T *i = start(this, true); i; i = next(this), count++) sum += (double)*i;
+				if constexpr (stages::is_direct<S>::value)
+				{
+					count	= this->stage.size();
+					sum		= kernels::sum<double>(count, this->direct<double>(selector));
+				}
+				else
+				{
+					for (T *i = this->stage.start(true); i; i = this->stage.next(), count++) sum += (double)selector(std::as_const(*i));
+				}
 
 				if (!count) throw std::runtime_error("query::average invalid since query result is empty");
 
@@ -474,37 +455,64 @@ namespace ent
 			}
 
 
-			template <class U> U sum(std::function<const U(const T&)> selector)
+			template <class U = void, class F> auto sum(F selector)
 			{
-				static_assert(std::is_arithmetic<U>::value, "query::sum is only suitable for arithmetic types");
+				using R = selected<U, F, const T&>;
+				static_assert(std::is_arithmetic_v<R>, "query::sum is only suitable for arithmetic types");
 
-				U result = 0;
+				if constexpr (stages::is_direct<S>::value)
+				{
+					return kernels::sum<R>(this->stage.size(), this->direct<R>(selector));
+				}
+				else
+				{
+					R result = 0;
 
-				if (selector) 	for (T *i = start(this, true); i; i = next(this)) result += selector(*i);
-				else			for (T *i = start(this, true); i; i = next(this)) result += *i;
+					for (T *i = this->stage.start(true); i; i = this->stage.next()) result += selector(std::as_const(*i));
 
-				return result;
+					return result;
+				}
+			}
+
+
+			template <class U = void, class F> auto stable_sum(F selector)
+			{
+				using R = selected<U, F, const T&>;
+				static_assert(std::is_arithmetic_v<R>, "query::stable_sum is only suitable for arithmetic types");
+
+				if constexpr (stages::is_direct<S>::value)
+				{
+					return kernels::stable_sum<R>(this->stage.size(), this->direct<R>(selector));
+				}
+				else
+				{
+					kernels::compensated<R> result;
+
+					for (T *i = this->stage.start(true); i; i = this->stage.next()) result.add(selector(std::as_const(*i)));
+
+					return result.result();
+				}
 			}
 
 
 			// Will return a new container of items but only where the given container type
-			// supports emplace_back.
+			// supports insert.
 			template <class U, class = typename std::enable_if<std::is_same<T, typename U::value_type>::value>::type> U to()
 			{
 				U result;
 
 				// Using insert works for vectors, lists and sets.
-				for (T *i = start(this, true); i; i = next(this)) result.insert(result.end(), *i);
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) result.insert(result.end(), *i);
 
 				return result;
 			}
 
 
-			template <class U, class V> std::map<U, V> map(std::function<const U(const T&)> key, std::function<const V(const T&)> value)
+			template <class U = void, class V = void, class F, class G> auto map(F key, G value)
 			{
-				std::map<U, V> result;
+				std::map<selected<U, F, const T&>, selected<V, G, const T&>> result;
 
-				for (T *i = start(this, true); i; i = next(this)) result[key(*i)] = value(*i);
+				for (T *i = this->stage.start(true); i; i = this->stage.next()) result[key(std::as_const(*i))] = value(std::as_const(*i));
 
 				return result;
 			}
@@ -515,6 +523,29 @@ namespace ent
 			std::set<T> set()		{ return to<std::set<T>>(); }
 
 
+			// Returns a copy of the query that reads from the given container instead. This allows a
+			// pipeline to be defined once (see ent::plan) and then evaluated against many containers
+			// of the same type. Each copy has its own iteration state, so copies may be evaluated
+			// concurrently, whereas a single query instance must not be. Queries that combine other
+			// sequences (with concat, except, intersect, join or zip) cannot be bound.
+			template <class U> auto bind(U &data) const
+			{
+				static_assert(stages::is_bindable<S>::value, "query::bind requires a query over a single container (without concat/except/intersect/join/zip)");
+
+				query result = *this;
+				result.stage.bind(data);
+
+				return result;
+			}
+
+
+			// Describes the stages of the query in the order that items pass through them
+			std::string explain() const
+			{
+				return stages::explain<S>::text();
+			}
+
+
 			// Basic iterator that allows query to be used in a for( : ) each loop without
 			// needing to first convert to a vector (avoids unnecessary memory allocation).
 			struct iterator
@@ -527,21 +558,21 @@ namespace ent
 
 				iterator() {}
 
-				iterator(const query<T> &q, bool forward) : q(q)
+				iterator(const S &stage, bool forward) : stage(stage)
 				{
-					this->current = this->q.start(&this->q, forward);
+					this->current = this->stage->start(forward);
 				}
 
 				iterator operator++(int)
 				{
 					iterator result = *this;
-					this->current = this->q.next(&this->q);
+					this->current = this->stage->next();
 					return result;
 				}
 
 				iterator &operator++()
 				{
-					this->current = this->q.next(&this->q);
+					this->current = this->stage->next();
 					return *this;
 				}
 
@@ -550,69 +581,109 @@ namespace ent
 				T &operator*()								{ return *this->current; }
 
 				private:
-					query<T> q;
+					std::optional<S> stage;
 					T *current = nullptr;
 			};
 
 
-			iterator begin() const	{ return iterator(*this, true); }
+			iterator begin() const	{ return iterator(this->stage, true); }
 			iterator end()	const	{ return iterator(); }
-			iterator rbegin() const	{ return iterator(*this, false); }
+			iterator rbegin() const	{ return iterator(this->stage, false); }
 			iterator rend()	const	{ return iterator(); }
 
+
 		private:
 
-			struct ibase
+			template <class N> static query<typename N::value_type, N> wrap(N stage)
+			{
+				return query<typename N::value_type, N>(std::move(stage));
+			}
+
+
+			struct identity
 			{
-				virtual ~ibase() {}
-				virtual T *next() = 0;
+				const T &operator()(const T &item) const { return item; }
 			};
 
-			template<class C> struct iterators : ibase
+
+			// Orders items by the key returned by a function
+			template <class U, class F> struct ordering
 			{
-				C current, end;
+				using key_type = selected<U, F, const T&>;
 
-				iterators(C start, C end) : current(start), end(end) {}
+				F selector;
+				bool descending;
 
-				T *next() { return (current != end) ? &*current++ : nullptr; }
+				key_type key(const T &item) const { return this->selector(item); }
+
+				bool less(const key_type &a, const key_type &b) const
+				{
+					return this->descending ? b < a : a < b;
+				}
 			};
 
 
-			query() {}
+			// Orders using the second key only where the first keys are equivalent
+			template <class A, class B> struct compound
+			{
+				using key_type = std::pair<typename A::key_type, typename B::key_type>;
+
+				A first;
+				B second;
+
+				key_type key(const T &item) const { return { this->first.key(item), this->second.key(item) }; }
 
-			template <class U> query(query<U> &parent, std::function<T *(qbase *, bool)> start, std::function<T *(qbase *)> next)
+				bool less(const key_type &a, const key_type &b) const
+				{
+					return this->first.less(a.first, b.first) || (!this->first.less(b.first, a.first) && this->second.less(a.second, b.second));
+				}
+			};
+
+
+			template <class N> struct sorted_source : std::false_type {};
+
+			template <class U> struct sorted_source<stages::ordered<U>> : std::true_type
 			{
-				this->parent		= std::make_shared<query<U>>(parent);
-				this->start			= start;
-				this->next			= next;
-			}
+				static auto get(const stages::ordered<U> &stage) { return stage; }
+			};
 
+			template <class U> struct sorted_source<stages::container<U>> : stages::is_sorted<U>
+			{
+				static auto get(const stages::container<U> &stage) { return stages::ordered<U>(stage.items(), {}, {}); }
+			};
 
-			// Used by the query instance that first referenced the source container data.
-			// The initialise function will store the begin and end iterators for the given container
-			// The next function is used to iterator over the items in the container
-			template <class U> void setup(U &data)
+
+			// The source as a range of a sorted container
+			auto sorted() const
 			{
-				this->start = [&](qbase *c, bool forward) {
-					if (forward) 	static_cast<query<T>*>(c)->it = std::make_shared<iterators<typename U::iterator>>(data.begin(), data.end());
-					else			static_cast<query<T>*>(c)->it = std::make_shared<iterators<typename U::reverse_iterator>>(data.rbegin(), data.rend());
-					return 			static_cast<query<T>*>(c)->it->next();
-				};
+				static_assert(sorted_source<S>::value, "query key operations require a std::map, std::set or ent::keyed_index source");
 
-				this->next = [](qbase *c) {
-					return static_cast<query<T>*>(c)->it->next();
-				};
+				return sorted_source<S>::get(this->stage);
 			}
 
 
+			template <class N> struct is_ordered : std::false_type {};
+			template <class P, class O, bool L> struct is_ordered<stages::order_by<P, O, L>> : std::true_type {};
+
+			template <class N> struct is_limited : std::false_type {};
+			template <class P, class O> struct is_limited<stages::order_by<P, O, true>> : std::true_type {};
+
+
 			T element_at(int index, bool except)
 			{
 				T *i = nullptr;
 
 				if (index >= 0)
 				{
-					int count = 0;
-					for (i = start(this, true); i && count < index; i = next(this), count++);
+					if constexpr (stages::is_indexed<S>::value)
+					{
+						i = this->stage.seek(index, true);
+					}
+					else
+					{
+						int count = 0;
+						for (i = this->stage.start(true); i && count < index; i = this->stage.next(), count++);
+					}
 				}
 
 				if (except && !i) throw std::runtime_error("query::element_at invalid since index is out of range");
@@ -621,11 +692,14 @@ namespace ent
 			}
 
 
-			T first_last(std::function<bool(const T&)> predicate, bool except, bool forward)
+			template <class F> T first_last(F predicate, bool except, bool forward)
 			{
-				T *i = start(this, forward);
+				T *i = this->stage.start(forward);
 
-				if (predicate) for (; i && !predicate(*i); i = next(this));
+				if constexpr (!std::is_null_pointer_v<F>)
+				{
+					for (; i && !predicate(std::as_const(*i)); i = this->stage.next());
+				}
 
 				if (except && !i) throw std::runtime_error("query::first/last invalid since query result is empty");
 
@@ -633,81 +707,65 @@ namespace ent
 			}
 
 
-			T single(std::function<bool(const T&)> predicate, bool except)
+			template <class F> T single(F predicate, bool except)
 			{
-				T *i = start(this, true);
+				T *i = this->stage.start(true);
 
-				if (predicate)		for(; i && !predicate(*i); i = next(this));
-				if (except && !i)	throw std::runtime_error("query::single invalid since query result is empty");
+				if constexpr (!std::is_null_pointer_v<F>)
+				{
+					for(; i && !predicate(std::as_const(*i)); i = this->stage.next());
+				}
+
+				if (except && !i) throw std::runtime_error("query::single invalid since query result is empty");
+
+				T *n = i ? this->stage.next() : nullptr;
 
-				T *n = next(this);
+				if constexpr (!std::is_null_pointer_v<F>)
+				{
+					for (; n && !predicate(std::as_const(*n)); n = this->stage.next());
+				}
 
-				if (predicate)	for (; n && !predicate(*n); n = next(this));
-				if (n)			throw std::runtime_error("query::single more than one result");
+				if (n) throw std::runtime_error("query::single more than one result");
 
 				return i ? *i : T();
 			}
 
 
-			T min_max(bool min)
+			// Access to the selected value of each item by index, for use with the kernels
+			template <class U, class F> auto direct(F &selector)
 			{
-				T *i = start(this, true);
-				if (!i) throw std::runtime_error("query::min/max invalid since query result is empty");
-
-				T result = *i;
-
-				if (min)	for (T *i = next(this); i; i = next(this)) result = std::min(result, *i);
-				else		for (T *i = next(this); i; i = next(this)) result = std::max(result, *i);
-
-				return result;
+				return [this, &selector](size_t index) -> U {
+					const T &item = this->stage.value(index);
+					return selector(item);
+				};
 			}
 
 
-			template <class U> U min_max(std::function<const U(const T&)> selector, bool min)
+			template <class U = T, class F> U min_max(F selector, bool min)
 			{
-				T *i = start(this, true);
-				if (!i) throw std::runtime_error("query::min/max invalid since query result is empty");
-
-				U result = selector(*i);
-
-				if (min)	for (T *i = next(this); i; i = next(this)) result = std::min(result, selector(*i));
-				else		for (T *i = next(this); i; i = next(this)) result = std::max(result, selector(*i));
+				if constexpr (stages::is_direct<S>::value && std::is_arithmetic_v<U>)
+				{
+					const size_t size = this->stage.size();
+					if (!size) throw std::runtime_error("query::min/max invalid since query result is empty");
 
-				return result;
-			}
+					return kernels::min_max<U>(size, this->direct<U>(selector), min);
+				}
 
+				T *i = this->stage.start(true);
+				if (!i) throw std::runtime_error("query::min/max invalid since query result is empty");
 
-			query<T> skip(int count, std::function<bool(const T&)> predicate)
-			{
-				return {
-					*this,
-					[=](qbase *c, bool forward) {
-						auto p 	= static_cast<query<T>*>(c->parent.get());
-						T *i	= p->start(p, forward);
+				U result = selector(std::as_const(*i));
 
-						if (predicate)	for (; i && predicate(*i); i = p->next(p));
-						else			for (int j=0; i && j<count; i = p->next(p), j++);
+				if (min)	for (i = this->stage.next(); i; i = this->stage.next()) result = std::min<U>(result, selector(std::as_const(*i)));
+				else		for (i = this->stage.next(); i; i = this->stage.next()) result = std::max<U>(result, selector(std::as_const(*i)));
 
-						return i;
-					},
-					[](qbase *c) {
-						return static_cast<query<T>*>(c->parent.get())->next(c->parent.get());
-					}
-				};
+				return result;
 			}
 
 
-			std::function<T *(qbase *, bool)> start;	// Initialises this link in the query chain and returns the first item
-			std::function<T *(qbase *)> next;			// Gets the next item from the chain
-			std::shared_ptr<ibase> it;					// Iterator storage
-			std::shared_ptr<std::vector<T>> buffer;		// Buffer used for storing initializer_list data or temporary data (see order_by)
-			std::list<std::shared_ptr<qbase>> queries;	// Handle parent queries in the correct order (see concat)
-			int counter = 0;							// Counter used by operations such as take and skip
-			T item;										// Temporary used to return a reference to a modified value
-
-			std::function<bool(const T&, const T&)> comparator = nullptr;
+			S stage;
 
-			template <class U> friend class query;
+			template <class, class> friend class query;
 	};
 
 
@@ -722,33 +780,27 @@ namespace ent
 	};
 
 
-	/*template <class T> class wrapper
+	template <class T, class = typename std::enable_if<is_container<T>::value && !is_query<T>::value>::type> auto from(T &data)
 	{
-		public:
+		return query<typename T::value_type, stages::container<T>>(data);
+	}
 
-			typedef T value_type;
-
-			wrapper(T *data, int size) : data(data), size(size) {}
-
-			T *begin()	{ return data; }
-			T *end()	{ return data + size; }
-			T *rbegin()	{ return data + size - 1; }	// Wrong - needs to decrement
-			T *rend()	{ return data - 1; }
-
-	private:
-
-			T *data;
-			int size;
-	};*/
+	template <class T> auto from(std::initializer_list<T> data)
+	{
+		return query<T, stages::buffer<T>>(data);
+	}
 
 
-	template <class T, class = typename std::enable_if<is_container<T>::value>::type> query<typename T::value_type> from(T &data) { return query<typename T::value_type>(data); }
-	template <class T> query<T> from(std::initializer_list<T> data) { return query<T>(data); }
-	//template <class T> query<T> from(T *data, int size) { return query<T>(wrapper<T>(data, size)); }
+	// An unbound query over containers of the given type, to which a pipeline can be added once
+	// and then bound to different containers (with query::bind) for each evaluation.
+	template <class U, class = typename std::enable_if<is_container<U>::value>::type> auto plan()
+	{
+		return query<typename U::value_type, stages::container<U>>(stages::container<U>());
+	}
 }
 
 
-/* 44/51
+/* 49/51
 -aggregate(reducer)
 -aggregate(seed, reducer)
 -aggregate(seed, reducer, selector)
@@ -769,11 +821,11 @@ namespace ent
 -first(predicate)
 -first_or_default()
 -first_or_default(predicate)
-group_by(key_selector)
-group_by(key_selector, element_selector)
+-group_by(key_selector)
+-group_by(key_selector, element_selector)
 group_join(range, outer_key_selector, inner_key_selector, result_selector)
-intersect(range)
-join(range, outer_key_selector, inner_key_selector, result_selector)
+-intersect(range)
+-join(range, outer_key_selector, inner_key_selector, result_selector)
 -last()
 -last(predicate)
 -last_or_default()
@@ -796,7 +848,7 @@ select_many(selector)
 -then_by(selector)
 -then_by_descending(selector)
 -to_container()
-union(range)
+-union(range)
 -where(predicate)
 -zip(range)
 -zip(range, selector)
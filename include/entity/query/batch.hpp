@@ -0,0 +1,187 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <entity/query/source.hpp>
+#include <entity/query/kernels.hpp>
+
+
+namespace ent
+{
+	// Terminal operations of a query evaluated a block at a time. Rather than passing a single
+	// item between stages on each call, every stage fills a block with pointers to the items it
+	// yields so that predicates and transformations are applied in tight loops and reductions
+	// can use the kernels. The results are identical to the sequential query apart from the
+	// order in which floating-point values are summed.
+	template <class T, class S> class batch_query
+	{
+		static_assert(stages::is_batched<S>::value, "query::batch requires a source followed only by where/select/take/skip");
+
+		public:
+
+			using value_type = T;
+
+			batch_query(S stage, size_t size = 1024) : stage(std::move(stage)), block(std::max<size_t>(1, size)) {}
+
+
+			template <class U, class F> U aggregate(const U seed, F accumulator)
+			{
+				U result = seed;
+
+				this->each([&](T **items, size_t size) {
+					for (size_t i = 0; i < size; i++) result = accumulator(std::as_const(result), std::as_const(*items[i]));
+				});
+
+				return result;
+			}
+
+
+			template <class F> bool all(F predicate)
+			{
+				return !this->any([&](const T &i) { return !predicate(i); });
+			}
+
+
+			template <class F> bool any(F predicate)
+			{
+				this->stage.open();
+
+				for (size_t size = this->fill(); size; size = this->fill())
+				{
+					for (size_t i = 0; i < size; i++) if (predicate(std::as_const(*this->block[i]))) return true;
+				}
+
+				return false;
+			}
+
+
+			int count()
+			{
+				int result = 0;
+
+				this->each([&](T **, size_t size) { result += size; });
+
+				return result;
+			}
+
+
+			template <class F> int count(F predicate)
+			{
+				int result = 0;
+
+				this->each([&](T **items, size_t size) {
+					for (size_t i = 0; i < size; i++) result += (bool)predicate(std::as_const(*items[i]));
+				});
+
+				return result;
+			}
+
+
+			T min()			{ return this->min_max<T>(identity(), true); }
+			T max()			{ return this->min_max<T>(identity(), false); }
+			T sum()			{ return this->sum<T>(identity()); }
+			double average()	{ return this->average<T>(identity()); }
+
+			template <class U = void, class F> auto min(F selector) { return this->min_max<selected<U, F>>(selector, true); }
+			template <class U = void, class F> auto max(F selector) { return this->min_max<selected<U, F>>(selector, false); }
+
+
+			template <class U = void, class F> double average(F selector)
+			{
+				static_assert(std::is_arithmetic_v<selected<U, F>>, "query::average is only suitable for arithmetic types");
+
+				size_t count	= 0;
+				double sum		= 0;
+
+				this->each([&](T **items, size_t size) {
+					sum		+= kernels::sum<double>(size, [&](size_t i) { return (double)selector(std::as_const(*items[i])); });
+					count	+= size;
+				});
+
+				if (!count) throw std::runtime_error("query::average invalid since query result is empty");
+
+				return sum / (double)count;
+			}
+
+
+			template <class U = void, class F> auto sum(F selector)
+			{
+				using R = selected<U, F>;
+				static_assert(std::is_arithmetic_v<R>, "query::sum is only suitable for arithmetic types");
+
+				R result = 0;
+
+				this->each([&](T **items, size_t size) {
+					result += kernels::sum<R>(size, [&](size_t i) { return selector(std::as_const(*items[i])); });
+				});
+
+				return result;
+			}
+
+
+			template <class U, class = typename std::enable_if<std::is_same<T, typename U::value_type>::value>::type> U to()
+			{
+				U result;
+
+				this->each([&](T **items, size_t size) {
+					for (size_t i = 0; i < size; i++) result.insert(result.end(), *items[i]);
+				});
+
+				return result;
+			}
+
+
+			std::vector<T> vector() { return to<std::vector<T>>(); }
+
+
+		private:
+
+			template <class U, class F> using selected = std::conditional_t<
+				std::is_void_v<U>, std::decay_t<std::invoke_result_t<F, const T&>>, U
+			>;
+
+
+			struct identity
+			{
+				const T &operator()(const T &item) const { return item; }
+			};
+
+
+			size_t fill() { return this->stage.fill(this->block.data(), this->block.size()); }
+
+
+			// Invoke the function with each block yielded by the pipeline
+			template <class F> void each(F function)
+			{
+				this->stage.open();
+
+				for (size_t size = this->fill(); size; size = this->fill())
+				{
+					function(this->block.data(), size);
+				}
+			}
+
+
+			template <class U, class F> U min_max(F selector, bool min)
+			{
+				std::optional<U> result;
+
+				this->each([&](T **items, size_t size) {
+					const U r = kernels::min_max<U>(size, [&](size_t i) { return selector(std::as_const(*items[i])); }, min);
+
+					result = result ? (min ? std::min<U>(*result, r) : std::max<U>(*result, r)) : r;
+				});
+
+				if (!result) throw std::runtime_error("query::min/max invalid since query result is empty");
+
+				return *result;
+			}
+
+
+			S stage;
+			std::vector<T *> block;
+	};
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <entity/entity.hpp>
+#include <entity/query.hpp>
+
+
+namespace ent::stages
+{
+	// A source that iterates over the items of an encoded array, decoding one item at a time
+	// into storage held by the stage rather than decoding the entire array into a container.
+	// The encoded data are referenced rather than copied, so must outlive the query. If a field
+	// name is given then the array is that field of the top-level object (which is required for
+	// codecs such as bson that only support a document at the top level).
+	//
+	// If a probe type and predicate are supplied then each item is first decoded as the probe,
+	// which is normally an entity describing a small subset of the fields, and the full item is
+	// only decoded where the predicate returns true. Probes rely upon fields being matched by
+	// name and so are not supported by positional codecs.
+	template <class Codec, class T, class Probe = void, class F = std::nullptr_t> class encoded
+	{
+		static_assert(std::is_base_of<codec, Codec>::value,	"Invalid codec specified");
+
+		public:
+
+			using value_type = T;
+
+			encoded(const std::string &data, F predicate, const std::string &field, bool skipValidation)
+				: data(&data), predicate(std::move(predicate)), field(field), skipValidation(skipValidation) {}
+
+			value_type *start(bool forward)
+			{
+				// A fresh codec discards any state left by a previous iteration that was not completed
+				auto &c			= this->c.emplace();
+				this->position	= 0;
+				this->active	= (this->skipValidation || c.validate(*this->data)) && this->locate(c);
+
+				if constexpr (!std::is_void_v<Probe>)
+				{
+					if (c.positional()) throw std::runtime_error("Error querying encoded data (probes are not supported by positional codecs)");
+				}
+
+				if (forward)
+				{
+					this->buffer.reset();
+					return this->next();
+				}
+
+				// The items can only be decoded in order, so they are buffered to iterate in reverse
+				this->buffer.emplace();
+
+				for (T *i = this->decode(); i; i = this->decode())
+				{
+					this->buffer->items.emplace_back(std::move(*i));
+				}
+
+				return this->buffer->start(false);
+			}
+
+			value_type *next()
+			{
+				return this->buffer ? this->buffer->next() : this->decode();
+			}
+
+		private:
+
+			bool locate(const Codec &c)
+			{
+				const std::string &data = *this->data;
+
+				if (this->field.empty())
+				{
+					return c.array_start(data, this->position, -1);
+				}
+
+				if (c.object_start(data, this->position, -1))
+				{
+					string name;
+
+					for (int type = 0; c.item(data, this->position, name, type);)
+					{
+						if (name == this->field)
+						{
+							return c.array_start(data, this->position, type);
+						}
+
+						c.skip(data, this->position, type);
+					}
+				}
+
+				return false;
+			}
+
+
+			value_type *decode()
+			{
+				const std::string &data	= *this->data;
+				const Codec &c			= *this->c;
+
+				for (int type = 0; this->active && c.array_item(data, this->position, type);)
+				{
+					if constexpr (!std::is_void_v<Probe>)
+					{
+						Probe probe;
+						const int end = vref<Probe>::decode(probe, c, data, this->position, type);
+
+						if (!this->predicate(std::as_const(probe)))
+						{
+							this->position = end;
+							continue;
+						}
+					}
+
+					this->item		= T();
+					this->position	= vref<T>::decode(this->item, c, data, this->position, type);
+
+					return &this->item;
+				}
+
+				if (this->active)
+				{
+					c.array_end(data, this->position);
+					this->active = false;
+				}
+
+				return nullptr;
+			}
+
+			const std::string *data;
+			F predicate;
+			std::string field;
+			bool skipValidation;
+
+			std::optional<Codec> c;
+			T item;
+			int position	= 0;
+			bool active		= false;
+			std::optional<cursor<T>> buffer;
+	};
+
+
+	template <class Codec, class T, class Probe, class F> struct explain<encoded<Codec, T, Probe, F>>
+	{
+		static std::string text() { return std::is_void_v<Probe> ? "decode" : "decode (probe)"; }
+	};
+}
+
+
+namespace ent
+{
+	// Query the items of an encoded array without first decoding it into a container. The array
+	// is either the top-level item or the named field of the top-level object.
+	template <class Codec, class T> auto from(const std::string &data, const std::string &field = "", bool skipValidation = false)
+	{
+		return query<T, stages::encoded<Codec, T>>({ data, nullptr, field, skipValidation });
+	}
+
+
+	// Query the items of an encoded array, where each item is first decoded as the probe type
+	// and then only fully decoded if the predicate returns true for the probe.
+	template <class Codec, class T, class Probe, class F> auto from(const std::string &data, F predicate, const std::string &field = "", bool skipValidation = false)
+	{
+		return query<T, stages::encoded<Codec, T, Probe, F>>({ data, std::move(predicate), field, skipValidation });
+	}
+}
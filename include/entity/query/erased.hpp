@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include <entity/query/source.hpp>
+
+
+namespace ent::stages
+{
+	// Type-erased stage which can hold any pipeline yielding T. This is the stage behind the
+	// plain query<T> type, allowing queries to be stored or passed around without naming the
+	// full pipeline type, at the cost of a virtual call per item. When evaluated with
+	// query::batch there is instead a virtual call per block of items.
+	template <class T> class erased
+	{
+		public:
+
+			using value_type = T;
+
+			static constexpr bool batched = true;
+
+			template <class S, class = std::enable_if_t<!std::is_same_v<std::decay_t<S>, erased>>> erased(S stage)
+				: stage(std::make_unique<model<S>>(std::move(stage))) {}
+
+			erased(const erased &copy) : stage(copy.stage->clone()) {}
+			erased(erased &&) = default;
+
+			erased &operator=(const erased &copy)
+			{
+				this->stage = copy.stage->clone();
+				return *this;
+			}
+
+			erased &operator=(erased &&) = default;
+
+			value_type *start(bool forward)	{ return this->stage->start(forward); }
+			value_type *next()				{ return this->stage->next(); }
+
+			void open()										{ this->stage->open(); }
+			size_t fill(value_type **block, size_t capacity)	{ return this->stage->fill(block, capacity); }
+
+		private:
+
+			struct concept_t
+			{
+				virtual ~concept_t() {}
+				virtual value_type *start(bool forward) = 0;
+				virtual value_type *next() = 0;
+				virtual void open() = 0;
+				virtual size_t fill(value_type **block, size_t capacity) = 0;
+				virtual std::unique_ptr<concept_t> clone() const = 0;
+			};
+
+			template <class S> struct model : concept_t
+			{
+				S stage;
+				value_type *pending = nullptr;	// Next item when filling blocks from a stage that is not batched
+				std::vector<value_type> items;	// Copies of the items in a block where the stage reuses storage
+
+				model(S stage) : stage(std::move(stage)) {}
+
+				value_type *start(bool forward) override			{ return this->stage.start(forward); }
+				value_type *next() override						{ return this->stage.next(); }
+				std::unique_ptr<concept_t> clone() const override	{ return std::make_unique<model<S>>(*this); }
+
+				void open() override
+				{
+					if constexpr (is_batched<S>::value)	this->stage.open();
+					else								this->pending = this->stage.start(true);
+				}
+
+				size_t fill(value_type **block, size_t capacity) override
+				{
+					if constexpr (is_batched<S>::value)
+					{
+						return this->stage.fill(block, capacity);
+					}
+					else
+					{
+						size_t n = 0;
+
+						if constexpr (!is_persistent<S>::value)
+						{
+							this->items.clear();
+							this->items.reserve(capacity);
+						}
+
+						for (; n < capacity && this->pending; this->pending = this->stage.next())
+						{
+							if constexpr (is_persistent<S>::value)	block[n++] = this->pending;
+							else									block[n++] = &this->items.emplace_back(*this->pending);
+						}
+
+						return n;
+					}
+				}
+			};
+
+			std::unique_ptr<concept_t> stage;
+	};
+}
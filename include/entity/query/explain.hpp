@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <entity/query/source.hpp>
+#include <entity/query/stages.hpp>
+#include <entity/query/erased.hpp>
+
+
+// A description of the plan for a query pipeline, as returned by query::explain. The stages
+// are listed in the order that items pass through them, so that it is possible to check, for
+// example, whether a sorted source is searched by key or scanned in full.
+namespace ent::stages
+{
+	template <class S> struct explain
+	{
+		static std::string text() { return "custom"; }
+	};
+
+	template <class U> struct explain<container<U>>			{ static std::string text() { return "scan"; } };
+	template <class T> struct explain<buffer<T>>				{ static std::string text() { return "scan"; } };
+	template <class U> struct explain<ordered<U>>				{ static std::string text() { return "sorted range (binary search)"; } };
+	template <class T> struct explain<erased<T>>				{ static std::string text() { return "erased"; } };
+
+	template <class P, class F> struct explain<where<P, F>>						{ static std::string text() { return explain<P>::text() + " -> where"; } };
+	template <class P, class F, class U> struct explain<select<P, F, U>>			{ static std::string text() { return explain<P>::text() + " -> select"; } };
+	template <class P> struct explain<take<P>>									{ static std::string text() { return explain<P>::text() + " -> take"; } };
+	template <class P, class F> struct explain<take_while<P, F>>					{ static std::string text() { return explain<P>::text() + " -> take_while"; } };
+	template <class P> struct explain<skip<P>>									{ static std::string text() { return explain<P>::text() + (is_indexed<P>::value ? " -> skip (seek)" : " -> skip"); } };
+	template <class P, class F> struct explain<skip_while<P, F>>					{ static std::string text() { return explain<P>::text() + " -> skip_while"; } };
+	template <class P> struct explain<reverse<P>>								{ static std::string text() { return explain<P>::text() + " -> reverse"; } };
+	template <class P, class H, class E> struct explain<distinct<P, H, E>>		{ static std::string text() { return explain<P>::text() + " -> distinct (hash)"; } };
+	template <class P, class O, bool L> struct explain<order_by<P, O, L>>		{ static std::string text() { return explain<P>::text() + (L ? " -> order_by (partial sort)" : " -> order_by"); } };
+	template <class P> struct explain<default_if_empty<P>>						{ static std::string text() { return explain<P>::text() + " -> default_if_empty"; } };
+
+	template <class P, class Q> struct explain<concat<P, Q>>
+	{
+		static std::string text() { return explain<P>::text() + " -> concat(" + explain<Q>::text() + ")"; }
+	};
+
+	template <class P, class Q, class H, class E, bool X> struct explain<filter_set<P, Q, H, E, X>>
+	{
+		static std::string text() { return explain<P>::text() + (X ? " -> except(" : " -> intersect(") + explain<Q>::text() + ") (hash)"; }
+	};
+
+	template <class P, class Q, class F, class U> struct explain<zip<P, Q, F, U>>
+	{
+		static std::string text() { return explain<P>::text() + " -> zip(" + explain<Q>::text() + ")"; }
+	};
+
+	template <class P, class F, class G, class K, class V, class H, class E> struct explain<group_by<P, F, G, K, V, H, E>>
+	{
+		static std::string text() { return explain<P>::text() + " -> group_by (hash)"; }
+	};
+
+	template <class P, class Q, class F, class G, class R, class K, class U, class H, class E> struct explain<join<P, Q, F, G, R, K, U, H, E>>
+	{
+		static std::string text() { return explain<P>::text() + " -> join(" + explain<Q>::text() + ") (hash)"; }
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+
+// Numeric reductions over items that can be accessed directly by index. Each function takes
+// the number of items and a function returning the value at a given index. The items are
+// distributed over a number of independent accumulators, which removes the dependency between
+// successive operations so that the loops can be vectorised and pipelined by the compiler.
+// For floating-point types this means the additions are performed in a different order to a
+// simple loop, so results may differ in the least significant bits.
+namespace ent::kernels
+{
+	static constexpr size_t Lanes = 8;
+
+
+	template <class R, class F> R sum(size_t size, F value)
+	{
+		R lanes[Lanes] = {};
+		size_t i = 0;
+
+		for (; i + Lanes <= size; i += Lanes)
+		{
+			for (size_t j = 0; j < Lanes; j++) lanes[j] += value(i + j);
+		}
+
+		// The remainder is fewer than Lanes items, bounding on j lets the compiler prove this
+		for (size_t j = 0; j < Lanes && i < size; i++, j++) lanes[j] += value(i);
+
+		R result = 0;
+
+		for (auto &l : lanes) result += l;
+
+		return result;
+	}
+
+
+	// The size must be greater than zero
+	template <class R, class F> R min_max(size_t size, F value, bool min)
+	{
+		R lanes[Lanes];
+		size_t i = 0;
+
+		for (auto &l : lanes) l = value(0);
+
+		if (min)
+		{
+			for (; i + Lanes <= size; i += Lanes)
+			{
+				for (size_t j = 0; j < Lanes; j++) lanes[j] = std::min<R>(lanes[j], value(i + j));
+			}
+
+			for (size_t j = 0; j < Lanes && i < size; i++, j++) lanes[j] = std::min<R>(lanes[j], value(i));
+
+			return *std::min_element(lanes, lanes + Lanes);
+		}
+
+		for (; i + Lanes <= size; i += Lanes)
+		{
+			for (size_t j = 0; j < Lanes; j++) lanes[j] = std::max<R>(lanes[j], value(i + j));
+		}
+
+		for (size_t j = 0; j < Lanes && i < size; i++, j++) lanes[j] = std::max<R>(lanes[j], value(i));
+
+		return *std::max_element(lanes, lanes + Lanes);
+	}
+
+
+	// Kahan-Babuska (Neumaier) compensated summation, which tracks the low-order bits lost by
+	// each addition so that the error does not grow with the number of items.
+	template <class R> struct compensated
+	{
+		R sum		= 0;
+		R error		= 0;
+
+		void add(const R value)
+		{
+			const R total = this->sum + value;
+
+			this->error	+= std::abs(this->sum) >= std::abs(value) ? (this->sum - total) + value : (value - total) + this->sum;
+			this->sum	= total;
+		}
+
+		R result() const { return this->sum + this->error; }
+	};
+
+
+	template <class R, class F> R stable_sum(size_t size, F value)
+	{
+		compensated<R> lanes[Lanes];
+		compensated<R> result;
+		size_t i = 0;
+
+		for (; i + Lanes <= size; i += Lanes)
+		{
+			for (size_t j = 0; j < Lanes; j++) lanes[j].add(value(i + j));
+		}
+
+		for (size_t j = 0; j < Lanes && i < size; i++, j++) lanes[j].add(value(i));
+
+		for (auto &l : lanes)
+		{
+			result.add(l.sum);
+			result.add(l.error);
+		}
+
+		return result.result();
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <entity/query/source.hpp>
+
+
+namespace ent
+{
+	// A secondary index over the items of a container, sorted by the key returned by a selector.
+	// Querying the index iterates over the items in key order and allows them to be restricted
+	// by key with a binary search (see query::where_key). The index holds pointers to the items,
+	// so it must be rebuilt if the container is modified in a way that moves them.
+	template <class T, class K, class C = std::less<K>> class keyed_index
+	{
+		struct entry
+		{
+			K key;
+			T *item;
+		};
+
+		using position = typename std::vector<entry>::const_iterator;
+
+		public:
+
+			using key_type		= K;
+			using value_type	= T;
+			using key_compare	= C;
+
+
+			class iterator
+			{
+				public:
+
+					using iterator_category	= std::bidirectional_iterator_tag;
+					using value_type		= T;
+					using difference_type	= std::ptrdiff_t;
+					using pointer			= T*;
+					using reference			= T&;
+
+					iterator() {}
+					iterator(position current) : current(current) {}
+
+					T &operator*() const	{ return *this->current->item; }
+					T *operator->() const	{ return this->current->item; }
+
+					iterator &operator++()		{ ++this->current; return *this; }
+					iterator &operator--()		{ --this->current; return *this; }
+					iterator operator++(int)	{ return iterator(this->current++); }
+					iterator operator--(int)	{ return iterator(this->current--); }
+
+					bool operator==(const iterator &i) const { return this->current == i.current; }
+					bool operator!=(const iterator &i) const { return this->current != i.current; }
+
+				private:
+
+					position current;
+			};
+
+			using reverse_iterator = std::reverse_iterator<iterator>;
+
+
+			template <class U, class F> keyed_index(U &items, F selector, C compare = C()) : compare(std::move(compare))
+			{
+				for (auto &i : items)
+				{
+					this->entries.push_back({ selector(std::as_const(i)), stages::address(i) });
+				}
+
+				std::stable_sort(this->entries.begin(), this->entries.end(), [&](auto &a, auto &b) {
+					return this->compare(a.key, b.key);
+				});
+			}
+
+
+			iterator begin() const				{ return this->entries.begin(); }
+			iterator end() const				{ return this->entries.end(); }
+			reverse_iterator rbegin() const		{ return reverse_iterator(this->end()); }
+			reverse_iterator rend() const		{ return reverse_iterator(this->begin()); }
+			size_t size() const					{ return this->entries.size(); }
+			key_compare key_comp() const		{ return this->compare; }
+
+
+			iterator lower_bound(const K &key) const
+			{
+				return std::lower_bound(this->entries.begin(), this->entries.end(), key, [&](auto &e, auto &k) {
+					return this->compare(e.key, k);
+				});
+			}
+
+
+			iterator upper_bound(const K &key) const
+			{
+				return std::upper_bound(this->entries.begin(), this->entries.end(), key, [&](auto &k, auto &e) {
+					return this->compare(k, e.key);
+				});
+			}
+
+		private:
+
+			std::vector<entry> entries;
+			C compare;
+	};
+
+
+	// Build an index over a container where the key type is that returned by the selector
+	template <class U, class F> auto index_by(U &items, F selector)
+	{
+		using T = typename U::value_type;
+
+		return keyed_index<T, std::decay_t<std::invoke_result_t<F, const T&>>>(items, std::move(selector));
+	}
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <entity/query/source.hpp>
+
+
+namespace ent
+{
+	// Terminal operations of a query evaluated across multiple threads. The source is divided into
+	// contiguous ranges, a copy of the pipeline is run over each range and the partial results are
+	// then combined in order, so materialised results keep the same order as the sequential query.
+	// Every function object in the pipeline (and those passed to the operations below) is invoked
+	// concurrently and must therefore be safe to do so.
+	template <class T, class S> class parallel_query
+	{
+		static_assert(stages::is_partitionable<S>::value, "query::parallel requires a random access source followed only by where/select");
+
+		public:
+
+			using value_type = T;
+
+			// Minimum number of source items assigned to each thread, below which the cost of
+			// starting a thread outweighs any benefit.
+			static constexpr size_t Granularity = 4096;
+
+			// If the number of threads is not specified then the hardware concurrency is used
+			parallel_query(S stage, int threads = 0) : stage(std::move(stage)), threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+
+			// Each partition starts from the seed and the partial results are merged with the
+			// combiner, so the seed must be an identity value for the combiner.
+			template <class U, class F, class G> U aggregate(const U seed, F accumulator, G combiner)
+			{
+				auto partials = this->run<U>([&](S &stage) {
+					U result = seed;
+
+					for (T *i = stage.start(true); i; i = stage.next()) result = accumulator(std::as_const(result), std::as_const(*i));
+
+					return result;
+				});
+
+				U result = std::move(partials.front());
+
+				for (size_t i = 1; i < partials.size(); i++) result = combiner(std::as_const(result), std::as_const(partials[i]));
+
+				return result;
+			}
+
+
+			template <class F> bool all(F predicate)
+			{
+				return !this->any([&](const T &i) { return !predicate(i); });
+			}
+
+
+			template <class F> bool any(F predicate)
+			{
+				std::atomic<bool> found = false;
+
+				this->run<bool>([&](S &stage) {
+					// Stop early once any partition has found a match
+					for (T *i = stage.start(true); i && !found.load(std::memory_order_relaxed); i = stage.next())
+					{
+						if (predicate(std::as_const(*i))) found = true;
+					}
+
+					return true;
+				});
+
+				return found;
+			}
+
+
+			int count() { return this->count([](const T &) { return true; }); }
+
+
+			template <class F> int count(F predicate)
+			{
+				int result = 0;
+
+				for (int c : this->run<int>([&](S &stage) {
+					int result = 0;
+
+					for (T *i = stage.start(true); i; i = stage.next()) if (predicate(std::as_const(*i))) result++;
+
+					return result;
+				})) result += c;
+
+				return result;
+			}
+
+
+			T min()			{ return this->min_max<T>(identity(), true); }
+			T max()			{ return this->min_max<T>(identity(), false); }
+			T sum()			{ return this->sum<T>(identity()); }
+			double average()	{ return this->average<T>(identity()); }
+
+			template <class U = void, class F> auto min(F selector) { return this->min_max<selected<U, F>>(selector, true); }
+			template <class U = void, class F> auto max(F selector) { return this->min_max<selected<U, F>>(selector, false); }
+
+
+			template <class U = void, class F> double average(F selector)
+			{
+				static_assert(std::is_arithmetic_v<selected<U, F>>, "query::average is only suitable for arithmetic types");
+
+				int count	= 0;
+				double sum	= 0;
+
+				for (auto &[s, c] : this->run<std::pair<double, int>>([&](S &stage) {
+					std::pair<double, int> result = { 0, 0 };
+
+					for (T *i = stage.start(true); i; i = stage.next(), result.second++) result.first += (double)selector(std::as_const(*i));
+
+					return result;
+				}))
+				{
+					sum		+= s;
+					count	+= c;
+				}
+
+				if (!count) throw std::runtime_error("query::average invalid since query result is empty");
+
+				return sum / (double)count;
+			}
+
+
+			template <class U = void, class F> auto sum(F selector)
+			{
+				using R = selected<U, F>;
+				static_assert(std::is_arithmetic_v<R>, "query::sum is only suitable for arithmetic types");
+
+				R result = 0;
+
+				for (R s : this->run<R>([&](S &stage) {
+					R result = 0;
+
+					for (T *i = stage.start(true); i; i = stage.next()) result += selector(std::as_const(*i));
+
+					return result;
+				})) result += s;
+
+				return result;
+			}
+
+
+			// The partial containers are concatenated in order, so for sequence containers
+			// the items appear in the same order as the sequential query would produce.
+			template <class U, class = typename std::enable_if<std::is_same<T, typename U::value_type>::value>::type> U to()
+			{
+				auto partials = this->run<U>([&](S &stage) {
+					U result;
+
+					for (T *i = stage.start(true); i; i = stage.next()) result.insert(result.end(), *i);
+
+					return result;
+				});
+
+				U result = std::move(partials.front());
+
+				for (size_t i = 1; i < partials.size(); i++) result.insert(result.end(), partials[i].begin(), partials[i].end());
+
+				return result;
+			}
+
+
+			std::vector<T> vector() { return to<std::vector<T>>(); }
+
+
+		private:
+
+			template <class U, class F> using selected = std::conditional_t<
+				std::is_void_v<U>, std::decay_t<std::invoke_result_t<F, const T&>>, U
+			>;
+
+
+			struct identity
+			{
+				const T &operator()(const T &item) const { return item; }
+			};
+
+
+			// Invoke the function with a copy of the pipeline for each partition of the source and
+			// return the results in partition order. The first partition is processed on the calling
+			// thread and any exception thrown by a partition is rethrown here.
+			template <class R, class F> std::vector<R> run(F function)
+			{
+				const size_t size	= this->stage.extent();
+				const size_t count	= std::max<size_t>(1, std::min<size_t>(this->threads, size / Granularity));
+
+				std::vector<std::optional<R>> results(count);
+				std::vector<std::exception_ptr> errors(count);
+				std::vector<std::thread> workers;
+
+				auto process = [&](size_t p) {
+					try
+					{
+						S stage = this->stage;
+						stage.partition(size * p / count, size * (p + 1) / count);
+						results[p] = function(stage);
+					}
+					catch (...)
+					{
+						errors[p] = std::current_exception();
+					}
+				};
+
+				workers.reserve(count - 1);
+
+				try
+				{
+					for (size_t p = 1; p < count; p++)
+					{
+						workers.emplace_back(process, p);
+					}
+				}
+				catch (...)
+				{
+					// Destroying a joinable thread terminates, so wait for any that did start
+					for (auto &w : workers) w.join();
+					throw;
+				}
+
+				process(0);
+
+				for (auto &w : workers) w.join();
+
+				for (auto &e : errors) if (e) std::rethrow_exception(e);
+
+				std::vector<R> result;
+				result.reserve(count);
+
+				for (auto &r : results) result.push_back(std::move(*r));
+
+				return result;
+			}
+
+
+			template <class U, class F> U min_max(F selector, bool min)
+			{
+				std::optional<U> result;
+
+				for (auto &r : this->run<std::optional<U>>([&](S &stage) {
+					std::optional<U> result;
+					T *i = stage.start(true);
+
+					if (i)
+					{
+						result = selector(std::as_const(*i));
+
+						if (min)	for (i = stage.next(); i; i = stage.next()) result = std::min<U>(*result, selector(std::as_const(*i)));
+						else		for (i = stage.next(); i; i = stage.next()) result = std::max<U>(*result, selector(std::as_const(*i)));
+					}
+
+					return result;
+				}))
+				{
+					if (r) result = result ? (min ? std::min<U>(*result, *r) : std::max<U>(*result, *r)) : *r;
+				}
+
+				if (!result) throw std::runtime_error("query::min/max invalid since query result is empty");
+
+				return *result;
+			}
+
+
+			S stage;
+			int threads;
+	};
+}
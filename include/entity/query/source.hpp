@@ -0,0 +1,392 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace ent::stages
+{
+	// Every stage in a query pipeline provides the following:
+	//
+	//   using value_type = ...;
+	//   value_type *start(bool forward);	// (Re)initialise the stage and return the first item
+	//   value_type *next();				// Return the next item
+	//
+	// where a nullptr indicates the end of the sequence. Stages are values that hold their parent
+	// stage and any function objects directly, so a complete pipeline is a single object whose
+	// type describes every operation and which can be copied to obtain an independent query.
+	//
+	// Stages that process each item independently of the others, over a source with random
+	// access, may also be partitioned so that ranges of the source can be processed in parallel:
+	//
+	//   static constexpr bool partitionable = true;
+	//   size_t extent() const;						// Number of items in the source
+	//   void partition(size_t begin, size_t end);	// Restrict the source to the given range
+
+	//
+	// Stages that know how many items they will return without iterating over them, or that can
+	// start at any position in constant time, declare one or both of the following:
+	//
+	//   static constexpr bool sized = true;
+	//   size_t size() const;								// Number of items in the sequence
+	//
+	//   static constexpr bool indexed = true;
+	//   value_type *seek(size_t index, bool forward);	// As start but beginning at the given index
+	//
+	// where seek returns nullptr if the index is beyond the end of the sequence and otherwise
+	// next continues from that position. Sized stages whose items can be obtained independently
+	// of any iteration state, such as a random access source followed only by select stages,
+	// allow numeric reductions to use the kernels which access items by index:
+	//
+	//   static constexpr bool direct = true;
+	//   decltype(auto) value(size_t index);				// The item at the given index
+	//
+	// Stages that can exchange blocks of items, for the batch execution engine, provide:
+	//
+	//   static constexpr bool batched = true;
+	//   void open();										// (Re)initialise the stage for forward iteration
+	//   size_t fill(value_type **block, size_t capacity);	// Fill a block with pointers to items
+	//
+	// where fill returns the number of items in the block, which is zero at the end of the
+	// sequence. The items in a block remain valid until the next call to fill.
+	//
+	// Stages that return pointers to items which remain valid until the stage is next started
+	// (rather than to a temporary that is overwritten by the following call to next) declare:
+	//
+	//   static constexpr bool persistent = true;
+	//
+	// Stages that read from a single container, so that it can be replaced (see query::bind),
+	// declare the following. Stages that combine other sequences do not, since those would still
+	// reference the containers they were built with.
+	//
+	//   static constexpr bool bindable = true;
+	//   void bind(U &data);								// Replace the container referenced by the source
+
+	template <class S, class = void> struct is_partitionable : std::false_type {};
+	template <class S> struct is_partitionable<S, std::enable_if_t<S::partitionable>> : std::true_type {};
+
+	template <class S, class = void> struct is_persistent : std::false_type {};
+	template <class S> struct is_persistent<S, std::enable_if_t<S::persistent>> : std::true_type {};
+
+	template <class S, class = void> struct is_sized : std::false_type {};
+	template <class S> struct is_sized<S, std::enable_if_t<S::sized>> : std::true_type {};
+
+	template <class S, class = void> struct is_indexed : std::false_type {};
+	template <class S> struct is_indexed<S, std::enable_if_t<S::indexed>> : std::true_type {};
+
+	template <class S, class = void> struct is_direct : std::false_type {};
+	template <class S> struct is_direct<S, std::enable_if_t<S::direct>> : std::true_type {};
+
+	template <class S, class = void> struct is_batched : std::false_type {};
+	template <class S> struct is_batched<S, std::enable_if_t<S::batched>> : std::true_type {};
+
+	template <class S, class = void> struct is_bindable : std::false_type {};
+	template <class S> struct is_bindable<S, std::enable_if_t<S::bindable>> : std::true_type {};
+
+	template <class U, class = void> struct has_size : std::false_type {};
+	template <class U> struct has_size<U, std::void_t<decltype(std::declval<const U &>().size())>> : std::true_type {};
+
+	// Containers that are sorted by key and support a binary search with lower_bound/upper_bound
+	template <class U, class = void> struct is_sorted : std::false_type {};
+	template <class U> struct is_sorted<U, std::void_t<typename U::key_compare>> : std::true_type {};
+
+
+	// The items of sets are only accessible through const iterators, but queries never modify
+	// the items of a source (function objects are always passed a const reference).
+	template <class T> T *address(const T &item) { return const_cast<T *>(&item); }
+
+
+	// The first stage in a query which iterates over a container that is referenced rather than
+	// copied, so the container must outlive the query.
+	template <class U> class container
+	{
+		public:
+
+			using value_type = typename U::value_type;
+
+			static constexpr bool persistent		= true;
+			static constexpr bool sized			= has_size<U>::value;
+			static constexpr bool indexed		= std::is_base_of_v<
+				std::random_access_iterator_tag, typename std::iterator_traits<typename U::iterator>::iterator_category
+			>;
+			static constexpr bool direct			= indexed && sized;
+			static constexpr bool batched		= true;
+			static constexpr bool partitionable	= indexed;
+			static constexpr bool bindable		= true;
+
+			container() {}
+			container(U &data) : data(&data) {}
+
+			value_type *start(bool forward)
+			{
+				this->reset(forward);
+				return this->next();
+			}
+
+			value_type *seek(size_t index, bool forward)
+			{
+				value_type *i = this->start(forward);
+
+				if (index && i)
+				{
+					const size_t remaining = forward ? this->end - this->current : this->rend - this->rcurrent;
+
+					if (index > remaining) return nullptr;
+
+					if (forward)	this->current	+= index - 1;
+					else			this->rcurrent	+= index - 1;
+
+					return this->next();
+				}
+
+				return i;
+			}
+
+			value_type &value(size_t index)	{ return this->data->begin()[index]; }
+			size_t size() const				{ return this->data->size(); }
+			size_t extent() const			{ return this->data->size(); }
+
+			void partition(size_t begin, size_t end)
+			{
+				this->partitioned	= true;
+				this->first			= begin;
+				this->last			= end;
+			}
+
+			value_type *next()
+			{
+				if (this->forward)	return this->current != this->end ? address(*this->current++) : nullptr;
+				else				return this->rcurrent != this->rend ? address(*this->rcurrent++) : nullptr;
+			}
+
+			void open() { this->reset(true); }
+
+			size_t fill(value_type **block, size_t capacity)
+			{
+				// Local copies avoid reloading the iterators after each store to the block
+				auto current	= this->current;
+				size_t n		= 0;
+
+				if constexpr (indexed)
+				{
+					n = std::min<size_t>(capacity, this->end - current);
+
+					for (size_t i = 0; i < n; i++) block[i] = address(current[i]);
+
+					current += n;
+				}
+				else
+				{
+					for (const auto end = this->end; n < capacity && current != end; n++) block[n] = address(*current++);
+				}
+
+				this->current = current;
+
+				return n;
+			}
+
+			void bind(U &data) { this->data = &data; }
+
+			// Access required when restricting a sorted container by key
+			U &items() const
+			{
+				if (!this->data) throw std::runtime_error("query plan has not been bound to a container");
+
+				return *this->data;
+			}
+
+		private:
+
+			void reset(bool forward)
+			{
+				if (!this->data) throw std::runtime_error("query plan has not been bound to a container");
+
+				this->forward = forward;
+
+				if (forward)
+				{
+					this->current	= this->data->begin();
+					this->end		= this->data->end();
+				}
+				else
+				{
+					this->rcurrent	= this->data->rbegin();
+					this->rend		= this->data->rend();
+				}
+
+				if constexpr (partitionable)
+				{
+					if (this->partitioned)
+					{
+						const size_t size = this->data->size();
+
+						if (forward)
+						{
+							this->end		= this->current + std::min(this->last, size);
+							this->current	+= std::min(this->first, size);
+						}
+						else
+						{
+							this->rend		= this->rcurrent + (size - std::min(this->first, size));
+							this->rcurrent	+= size - std::min(this->last, size);
+						}
+					}
+				}
+			}
+
+			U *data = nullptr;
+			typename U::iterator current, end;
+			typename U::reverse_iterator rcurrent, rend;
+			bool forward		= true;
+			bool partitioned	= false;
+			size_t first		= 0;
+			size_t last			= 0;
+	};
+
+
+	// A source that iterates over part of a container which is sorted by key (such as a map, set
+	// or ent::keyed_index), where the range of keys is found by binary search when started. The
+	// bounds are inclusive and either may be omitted. The container must outlive the query.
+	template <class U> class ordered
+	{
+		public:
+
+			using value_type	= typename U::value_type;
+			using key_type		= typename U::key_type;
+
+			static constexpr bool persistent	= true;
+			static constexpr bool bindable		= true;
+
+			ordered(U &data, std::optional<key_type> lower, std::optional<key_type> upper, bool descending = false)
+				: data(&data), lower(std::move(lower)), upper(std::move(upper)), descending(descending) {}
+
+			value_type *start(bool forward)
+			{
+				auto first	= this->lower ? this->data->lower_bound(*this->lower) : this->data->begin();
+				auto last	= this->upper ? this->data->upper_bound(*this->upper) : this->data->end();
+
+				// An inverted range would otherwise iterate beyond the end of the container
+				if (this->lower && this->upper && this->data->key_comp()(*this->upper, *this->lower))
+				{
+					last = first;
+				}
+
+				this->forward = forward != this->descending;
+
+				if (this->forward)
+				{
+					this->current	= first;
+					this->end		= last;
+				}
+				else
+				{
+					this->rcurrent	= std::make_reverse_iterator(last);
+					this->rend		= std::make_reverse_iterator(first);
+				}
+
+				return this->next();
+			}
+
+			value_type *next()
+			{
+				if (this->forward)	return this->current != this->end ? address(*this->current++) : nullptr;
+				else				return this->rcurrent != this->rend ? address(*this->rcurrent++) : nullptr;
+			}
+
+			// A new source restricted to the intersection of this range and the given bounds
+			ordered restrict(std::optional<key_type> lower, std::optional<key_type> upper) const
+			{
+				auto less = this->data->key_comp();
+
+				if (this->lower && (!lower || less(*lower, *this->lower)))	lower = this->lower;
+				if (this->upper && (!upper || less(*this->upper, *upper)))	upper = this->upper;
+
+				return { *this->data, std::move(lower), std::move(upper), this->descending };
+			}
+
+			ordered arrange(bool descending) const
+			{
+				return { *this->data, this->lower, this->upper, descending };
+			}
+
+			void bind(U &data) { this->data = &data; }
+
+		private:
+
+			U *data;
+			std::optional<key_type> lower, upper;
+			bool descending;
+
+			typename U::iterator current, end;
+			std::reverse_iterator<typename U::iterator> rcurrent, rend;
+			bool forward = true;
+	};
+
+
+	// A source that owns its data, used for initialiser lists. The data are shared between copies
+	// of the query but are never modified.
+	template <class T> class buffer
+	{
+		public:
+
+			using value_type = T;
+
+			static constexpr bool persistent		= true;
+			static constexpr bool sized			= true;
+			static constexpr bool indexed		= true;
+			static constexpr bool direct			= true;
+			static constexpr bool batched		= true;
+			static constexpr bool partitionable	= true;
+
+			buffer(std::initializer_list<T> data) : data(std::make_shared<std::vector<T>>(data)), source(*this->data) {}
+
+			value_type *start(bool forward)					{ return this->source.start(forward); }
+			value_type *next()								{ return this->source.next(); }
+			value_type *seek(size_t index, bool forward)	{ return this->source.seek(index, forward); }
+			value_type &value(size_t index)					{ return this->source.value(index); }
+			void open()										{ this->source.open(); }
+			size_t fill(value_type **block, size_t capacity)	{ return this->source.fill(block, capacity); }
+			size_t size() const								{ return this->source.size(); }
+			size_t extent() const							{ return this->source.extent(); }
+			void partition(size_t begin, size_t end)		{ this->source.partition(begin, end); }
+
+		private:
+
+			std::shared_ptr<std::vector<T>> data;
+			container<std::vector<T>> source;
+	};
+
+
+	// Iteration over items that have been copied into a stage, for operations such as
+	// distinct and order_by that must see the whole sequence before returning anything.
+	template <class T> class cursor
+	{
+		public:
+
+			std::vector<T> items;
+
+			T *start(bool forward)
+			{
+				this->forward	= forward;
+				this->index		= forward ? 0 : this->items.size();
+
+				return this->next();
+			}
+
+			T *next()
+			{
+				if (this->forward)	return this->index < this->items.size() ? &this->items[this->index++] : nullptr;
+				else				return this->index > 0 ? &this->items[--this->index] : nullptr;
+			}
+
+		private:
+
+			size_t index	= 0;
+			bool forward	= true;
+	};
+}
@@ -0,0 +1,783 @@
+#pragma once
+
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <entity/query/source.hpp>
+
+
+namespace ent
+{
+	// The items sharing a key, as produced by query::group_by
+	template <class K, class V> struct grouping
+	{
+		K key;
+		std::vector<V> items;
+
+		bool operator==(const grouping &g) const { return this->key == g.key && this->items == g.items; }
+	};
+}
+
+
+namespace ent::stages
+{
+	template <class P, class F> class where
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent		= is_persistent<P>::value;
+			static constexpr bool batched		= is_batched<P>::value;
+			static constexpr bool partitionable	= is_partitionable<P>::value;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			where(P parent, F predicate) : parent(std::move(parent)), predicate(std::move(predicate)) {}
+
+			value_type *start(bool forward)				{ return this->find(this->parent.start(forward)); }
+			value_type *next()							{ return this->find(this->parent.next()); }
+			size_t extent() const						{ return this->parent.extent(); }
+			void partition(size_t begin, size_t end)	{ this->parent.partition(begin, end); }
+			void open()									{ this->parent.open(); }
+
+			// Items that do not match are removed from each block in place
+			size_t fill(value_type **block, size_t capacity)
+			{
+				size_t n = 0;
+
+				while (!n)
+				{
+					const size_t size = this->parent.fill(block, capacity);
+
+					if (!size) return 0;
+
+					for (size_t i = 0; i < size; i++)
+					{
+						block[n] = block[i];
+						n += (bool)this->predicate(std::as_const(*block[i]));
+					}
+				}
+
+				return n;
+			}
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			value_type *find(value_type *i)
+			{
+				for (; i && !this->predicate(std::as_const(*i)); i = this->parent.next());
+
+				return i;
+			}
+
+			P parent;
+			F predicate;
+	};
+
+
+	template <class P, class F, class U> class select
+	{
+		public:
+
+			using value_type = U;
+
+			static constexpr bool sized			= is_sized<P>::value;
+			static constexpr bool indexed		= is_indexed<P>::value;
+			static constexpr bool direct			= is_direct<P>::value;
+			static constexpr bool batched		= is_batched<P>::value;
+			static constexpr bool partitionable	= is_partitionable<P>::value;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			select(P parent, F operation) : parent(std::move(parent)), operation(std::move(operation)) {}
+
+			value_type *start(bool forward)					{ return this->transform(this->parent.start(forward)); }
+			value_type *next()								{ return this->transform(this->parent.next()); }
+			value_type *seek(size_t index, bool forward)	{ return this->transform(this->parent.seek(index, forward)); }
+			size_t size() const								{ return this->parent.size(); }
+			size_t extent() const							{ return this->parent.extent(); }
+			void partition(size_t begin, size_t end)		{ this->parent.partition(begin, end); }
+
+			value_type value(size_t index)
+			{
+				const auto &item = this->parent.value(index);
+				return this->operation(item);
+			}
+
+			void open() { this->parent.open(); }
+
+			// Transformed values are written to a block owned by this stage
+			size_t fill(value_type **block, size_t capacity)
+			{
+				this->input.resize(capacity);
+				this->output.resize(capacity);
+
+				auto input			= this->input.data();
+				auto output			= this->output.data();
+				const size_t size	= this->parent.fill(input, capacity);
+
+				for (size_t i = 0; i < size; i++) output[i] = this->operation(std::as_const(*input[i]));
+				for (size_t i = 0; i < size; i++) block[i] = output + i;
+
+				return size;
+			}
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			value_type *transform(typename P::value_type *i)
+			{
+				return i ? &(this->item = this->operation(std::as_const(*i))) : nullptr;
+			}
+
+			P parent;
+			F operation;
+			U item;		// Temporary used to return a reference to a transformed value
+
+			std::vector<typename P::value_type *> input;
+			std::vector<U> output;
+	};
+
+
+	template <class P> class take
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool sized		= is_sized<P>::value;
+			static constexpr bool indexed	= is_indexed<P>::value;
+			static constexpr bool batched	= is_batched<P>::value;
+			static constexpr bool bindable	= is_bindable<P>::value;
+
+			take(P parent, int count) : parent(std::move(parent)), count(count) {}
+
+			value_type *start(bool forward)
+			{
+				this->counter = 1;
+				return this->count > 0 ? this->parent.start(forward) : nullptr;
+			}
+
+			value_type *seek(size_t index, bool forward)
+			{
+				this->counter = index + 1;
+				return index < this->limit() ? this->parent.seek(index, forward) : nullptr;
+			}
+
+			size_t size() const { return std::min(this->parent.size(), this->limit()); }
+
+			void open()
+			{
+				this->counter = 0;
+				this->parent.open();
+			}
+
+			size_t fill(value_type **block, size_t capacity)
+			{
+				const size_t size = this->counter < this->limit() ? this->parent.fill(block, std::min(capacity, this->limit() - this->counter)) : 0;
+				this->counter += size;
+
+				return size;
+			}
+
+			value_type *next()
+			{
+				return this->counter++ < this->limit() ? this->parent.next() : nullptr;
+			}
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			size_t limit() const { return std::max(this->count, 0); }
+
+			P parent;
+			int count;
+			size_t counter = 0;
+	};
+
+
+	template <class P, class F> class take_while
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			take_while(P parent, F predicate) : parent(std::move(parent)), predicate(std::move(predicate)) {}
+
+			value_type *start(bool forward)	{ return this->check(this->parent.start(forward)); }
+			value_type *next()				{ return this->check(this->parent.next()); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			value_type *check(value_type *i)
+			{
+				return i && this->predicate(std::as_const(*i)) ? i : nullptr;
+			}
+
+			P parent;
+			F predicate;
+	};
+
+
+	template <class P> class skip
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool sized		= is_sized<P>::value;
+			static constexpr bool indexed	= is_indexed<P>::value;
+			static constexpr bool batched	= is_batched<P>::value;
+			static constexpr bool bindable	= is_bindable<P>::value;
+
+			skip(P parent, int count) : parent(std::move(parent)), count(count) {}
+
+			value_type *start(bool forward)
+			{
+				if constexpr (indexed)
+				{
+					return this->parent.seek(this->offset(), forward);
+				}
+				else
+				{
+					value_type *i = this->parent.start(forward);
+
+					for (size_t j = 0; i && j < this->offset(); i = this->parent.next(), j++);
+
+					return i;
+				}
+			}
+
+			value_type *seek(size_t index, bool forward)	{ return this->parent.seek(index + this->offset(), forward); }
+			size_t size() const								{ return this->parent.size() - std::min(this->parent.size(), this->offset()); }
+
+			void open()
+			{
+				this->skipped = false;
+				this->parent.open();
+			}
+
+			size_t fill(value_type **block, size_t capacity)
+			{
+				for (size_t remaining = this->offset(); !this->skipped && remaining;)
+				{
+					const size_t size = this->parent.fill(block, std::min(capacity, remaining));
+
+					if (!size) return 0;
+
+					remaining -= size;
+				}
+
+				this->skipped = true;
+
+				return this->parent.fill(block, capacity);
+			}
+
+			value_type *next() { return this->parent.next(); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			size_t offset() const { return std::max(this->count, 0); }
+
+			P parent;
+			int count;
+			bool skipped = false;
+	};
+
+
+	template <class P, class F> class skip_while
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			skip_while(P parent, F predicate) : parent(std::move(parent)), predicate(std::move(predicate)) {}
+
+			value_type *start(bool forward)
+			{
+				value_type *i = this->parent.start(forward);
+
+				for (; i && this->predicate(std::as_const(*i)); i = this->parent.next());
+
+				return i;
+			}
+
+			value_type *next() { return this->parent.next(); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			P parent;
+			F predicate;
+	};
+
+
+	template <class P> class reverse
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool sized		= is_sized<P>::value;
+			static constexpr bool indexed	= is_indexed<P>::value;
+			static constexpr bool bindable	= is_bindable<P>::value;
+
+			reverse(P parent) : parent(std::move(parent)) {}
+
+			value_type *start(bool forward)					{ return this->parent.start(!forward); }
+			value_type *next()								{ return this->parent.next(); }
+			value_type *seek(size_t index, bool forward)	{ return this->parent.seek(index, !forward); }
+			size_t size() const								{ return this->parent.size(); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			P parent;
+	};
+
+
+	// Items are returned as they are found, skipping any equal to one already returned
+	template <class P, class H, class E> class distinct
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			distinct(P parent, H hash, E equal) : parent(std::move(parent)), seen(0, std::move(hash), std::move(equal)) {}
+
+			value_type *start(bool forward)
+			{
+				this->seen.clear();
+				return this->find(this->parent.start(forward));
+			}
+
+			value_type *next() { return this->find(this->parent.next()); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			value_type *find(value_type *i)
+			{
+				for (; i && !this->seen.insert(*i).second; i = this->parent.next());
+
+				return i;
+			}
+
+			P parent;
+			std::unordered_set<value_type, H, E> seen;
+	};
+
+
+	// Sorts by keys that are computed once per item, where the ordering provides:
+	//
+	//   using key_type = ...;
+	//   key_type key(const value_type &item) const;
+	//   bool less(const key_type &a, const key_type &b) const;
+	//
+	// The keys are sorted along with pointers to the items, so the items themselves are only
+	// copied if the parent stage cannot guarantee that they persist. Ties are broken by the
+	// original position, so the sort is stable. If a limit is given then only that many items
+	// are returned and a partial sort is used. Chaining with then_by or take replaces this
+	// stage with one that has a compound ordering or limit respectively. A stage that take
+	// has been fused into is Limited, which ends the chain as a separate take stage would.
+	template <class P, class O, bool Limited = false> class order_by
+	{
+		public:
+
+			using value_type	= typename P::value_type;
+			using parent_type	= P;
+			using ordering_type	= O;
+
+			static constexpr bool persistent	= true;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			order_by(P parent, O ordering, int limit = -1) : parent(std::move(parent)), order(std::move(ordering)), count(limit) {}
+
+			value_type *start(bool forward)
+			{
+				this->entries.clear();
+
+				if constexpr (is_persistent<P>::value)
+				{
+					for (value_type *i = this->parent.start(true); i; i = this->parent.next())
+					{
+						this->entries.push_back({ this->order.key(std::as_const(*i)), this->entries.size(), i });
+					}
+				}
+				else
+				{
+					auto &items = this->buffer.items;
+					items.clear();
+
+					for (value_type *i = this->parent.start(true); i; i = this->parent.next())
+					{
+						items.emplace_back(*i);
+					}
+
+					for (auto &i : items)
+					{
+						this->entries.push_back({ this->order.key(std::as_const(i)), this->entries.size(), &i });
+					}
+				}
+
+				auto compare = [&](const entry &a, const entry &b) {
+					return this->order.less(a.key, b.key) || (!this->order.less(b.key, a.key) && a.index < b.index);
+				};
+
+				// The limit applies in the direction of iteration, as a separate take stage would, so
+				// in reverse the last items are found by a partial sort in the opposite order
+				if (this->count >= 0 && (size_t)this->count < this->entries.size())
+				{
+					auto middle = this->entries.begin() + this->count;
+
+					if (forward)	std::partial_sort(this->entries.begin(), middle, this->entries.end(), compare);
+					else			std::partial_sort(this->entries.begin(), middle, this->entries.end(), [&](auto &a, auto &b) { return compare(b, a); });
+
+					this->entries.resize(this->count);
+					this->forward = true;
+				}
+				else
+				{
+					std::sort(this->entries.begin(), this->entries.end(), compare);
+					this->forward = forward;
+				}
+
+				this->index = this->forward ? 0 : this->entries.size();
+
+				return this->next();
+			}
+
+			value_type *next()
+			{
+				if (this->forward)	return this->index < this->entries.size() ? this->entries[this->index++].item : nullptr;
+				else				return this->index > 0 ? this->entries[--this->index].item : nullptr;
+			}
+
+			// Access required when chaining then_by and take
+			const P &source() const		{ return this->parent; }
+			const O &ordering() const	{ return this->order; }
+			int limit() const			{ return this->count; }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			struct entry
+			{
+				typename O::key_type key;
+				size_t index;
+				value_type *item;
+			};
+
+			P parent;
+			O order;
+			int count;
+			std::vector<entry> entries;
+			cursor<value_type> buffer;		// Copies of the items if the parent is not persistent
+			size_t index	= 0;
+			bool forward	= true;
+	};
+
+
+	template <class P, class Q> class concat
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value && is_persistent<Q>::value;
+			static constexpr bool sized		= is_sized<P>::value && is_sized<Q>::value;
+
+			concat(P parent, Q other) : parent(std::move(parent)), other(std::move(other)) {}
+
+			size_t size() const { return this->parent.size() + this->other.size(); }
+
+			value_type *start(bool forward)
+			{
+				this->forward	= forward;
+				this->second	= false;
+				value_type *i	= forward ? this->parent.start(true) : this->other.start(false);
+
+				return i ? i : this->switch_over();
+			}
+
+			value_type *next()
+			{
+				// Forwards the parent is iterated first, in reverse the other sequence is first
+				value_type *i = this->forward != this->second ? this->parent.next() : this->other.next();
+
+				return i || this->second ? i : this->switch_over();
+			}
+
+		private:
+
+			value_type *switch_over()
+			{
+				this->second = true;
+				return this->forward ? this->other.start(true) : this->parent.start(false);
+			}
+
+			P parent;
+			Q other;
+			bool forward	= true;
+			bool second		= false;
+	};
+
+
+	// Both except and intersect load the other sequence into a hash set when started. Except
+	// keeps any duplicates in the parent that do not appear in the other sequence, whereas
+	// intersect returns each common item only once.
+	template <class P, class Q, class H, class E, bool Exclude> class filter_set
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent = is_persistent<P>::value;
+
+			filter_set(P parent, Q other, H hash, E equal) : parent(std::move(parent)), other(std::move(other)), lookup(0, std::move(hash), std::move(equal)) {}
+
+			value_type *start(bool forward)
+			{
+				this->lookup.clear();
+
+				for (auto *i = this->other.start(true); i; i = this->other.next())
+				{
+					this->lookup.insert(*i);
+				}
+
+				return this->find(this->parent.start(forward));
+			}
+
+			value_type *next() { return this->find(this->parent.next()); }
+
+		private:
+
+			value_type *find(value_type *i)
+			{
+				if constexpr (Exclude)	for (; i && this->lookup.count(*i); i = this->parent.next());
+				else					for (; i && !this->lookup.erase(*i); i = this->parent.next());
+
+				return i;
+			}
+
+			P parent;
+			Q other;
+			std::unordered_set<value_type, H, E> lookup;
+	};
+
+	template <class P, class Q, class H, class E> using except		= filter_set<P, Q, H, E, true>;
+	template <class P, class Q, class H, class E> using intersect	= filter_set<P, Q, H, E, false>;
+
+
+	// Groups are returned in the order that their keys first appear
+	template <class P, class F, class G, class K, class V, class H, class E> class group_by
+	{
+		public:
+
+			using value_type = grouping<K, V>;
+
+			static constexpr bool persistent	= true;
+			static constexpr bool bindable		= is_bindable<P>::value;
+
+			group_by(P parent, F key, G element, H hash, E equal)
+				: parent(std::move(parent)), key(std::move(key)), element(std::move(element)), index(0, std::move(hash), std::move(equal)) {}
+
+			value_type *start(bool forward)
+			{
+				auto &groups = this->buffer.items;
+				groups.clear();
+				this->index.clear();
+
+				for (auto *i = this->parent.start(true); i; i = this->parent.next())
+				{
+					auto [position, added] = this->index.try_emplace(this->key(std::as_const(*i)), groups.size());
+
+					if (added)
+					{
+						groups.push_back({ position->first, {} });
+					}
+
+					groups[position->second].items.emplace_back(this->element(std::as_const(*i)));
+				}
+
+				return this->buffer.start(forward);
+			}
+
+			value_type *next() { return this->buffer.next(); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			P parent;
+			F key;
+			G element;
+			std::unordered_map<K, size_t, H, E> index;
+			cursor<value_type> buffer;
+	};
+
+
+	// A hash join, where the other (inner) sequence is loaded into a lookup table when started
+	// and then each item of the parent (outer) sequence is combined with every matching inner
+	// item in turn.
+	template <class P, class Q, class F, class G, class R, class K, class U, class H, class E> class join
+	{
+		public:
+
+			using value_type	= U;
+			using inner_type	= typename Q::value_type;
+
+			join(P parent, Q other, F outer, G inner, R operation, H hash, E equal)
+				: parent(std::move(parent)), other(std::move(other)), outer(std::move(outer)), inner(std::move(inner)),
+				  operation(std::move(operation)), lookup(0, std::move(hash), std::move(equal)) {}
+
+			value_type *start(bool forward)
+			{
+				this->forward	= forward;
+				this->remaining	= 0;
+				this->lookup.clear();
+
+				for (auto *i = this->other.start(true); i; i = this->other.next())
+				{
+					this->lookup[this->inner(std::as_const(*i))].push_back(*i);
+				}
+
+				return this->find(this->parent.start(forward));
+			}
+
+			value_type *next()
+			{
+				return this->remaining ? this->combine() : this->find(this->parent.next());
+			}
+
+		private:
+
+			value_type *find(typename P::value_type *i)
+			{
+				for (; i; i = this->parent.next())
+				{
+					auto match = this->lookup.find(this->outer(std::as_const(*i)));
+
+					if (match != this->lookup.end())
+					{
+						this->current	= i;
+						this->matches	= &match->second;
+						this->remaining	= match->second.size();
+
+						return this->combine();
+					}
+				}
+
+				return nullptr;
+			}
+
+			value_type *combine()
+			{
+				const size_t index = this->forward ? this->matches->size() - this->remaining : this->remaining - 1;
+				this->remaining--;
+
+				return &(this->item = this->operation(std::as_const(*this->current), std::as_const((*this->matches)[index])));
+			}
+
+			P parent;
+			Q other;
+			F outer;
+			G inner;
+			R operation;
+			std::unordered_map<K, std::vector<inner_type>, H, E> lookup;
+
+			typename P::value_type *current		= nullptr;
+			std::vector<inner_type> *matches	= nullptr;
+			size_t remaining					= 0;
+			bool forward						= true;
+			U item;
+	};
+
+
+	template <class P, class Q, class F, class U> class zip
+	{
+		public:
+
+			using value_type = U;
+
+			static constexpr bool sized		= is_sized<P>::value && is_sized<Q>::value;
+			static constexpr bool indexed	= is_indexed<P>::value && is_indexed<Q>::value;
+
+			zip(P parent, Q other, F operation) : parent(std::move(parent)), other(std::move(other)), operation(std::move(operation)) {}
+
+			value_type *start(bool forward)					{ return this->combine(this->parent.start(forward), this->other.start(forward)); }
+			value_type *next()								{ return this->combine(this->parent.next(), this->other.next()); }
+			value_type *seek(size_t index, bool forward)	{ return this->combine(this->parent.seek(index, forward), this->other.seek(index, forward)); }
+			size_t size() const								{ return std::min(this->parent.size(), this->other.size()); }
+
+		private:
+
+			value_type *combine(typename P::value_type *i, typename Q::value_type *j)
+			{
+				return i && j ? &(this->item = this->operation(std::as_const(*i), std::as_const(*j))) : nullptr;
+			}
+
+			P parent;
+			Q other;
+			F operation;
+			U item;
+	};
+
+
+	template <class P> class default_if_empty
+	{
+		public:
+
+			using value_type = typename P::value_type;
+
+			static constexpr bool persistent	= is_persistent<P>::value;
+			static constexpr bool sized		= is_sized<P>::value;
+			static constexpr bool bindable	= is_bindable<P>::value;
+
+			default_if_empty(P parent, value_type value) : parent(std::move(parent)), value(std::move(value)) {}
+
+			value_type *start(bool forward)
+			{
+				value_type *i	= this->parent.start(forward);
+				this->empty		= !i;
+
+				return i ? i : &(this->item = this->value);
+			}
+
+			value_type *next()	{ return this->empty ? nullptr : this->parent.next(); }
+			size_t size() const	{ return std::max<size_t>(this->parent.size(), 1); }
+
+			template <class D> void bind(D &data) { this->parent.bind(data); }
+
+		private:
+
+			P parent;
+			value_type value;
+			value_type item;
+			bool empty = false;
+	};
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <entity/codec.hpp>
+
+
+namespace ent
+{
+	// Wraps a codec so that an object referenced by more than one shared pointer is written once,
+	// as {"$id": n, "$value": ...}, and any later occurrence as {"$ref": n}. When decoded with the
+	// same wrapper the references share ownership of a single object again, which also permits
+	// circular references. For example encode<tracked<json>>(graph) and decode<tracked<json>, T>.
+	// Every shared pointer is written in this form, whereas unique pointers are unaffected.
+	//
+	// Decoding a circular graph recreates the cycle of shared pointers, which will never be
+	// released unless the application breaks the cycle (for example by resetting a pointer
+	// before the graph is discarded), since the objects own each other.
+	template <class Codec> struct tracked : Codec
+	{
+		static_assert(std::is_base_of<codec, Codec>::value, "Invalid codec specified");
+
+		references *tracker() const override { return &this->state; }
+
+		mutable references state;
+	};
+}
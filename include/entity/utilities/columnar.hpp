@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstring>
+#include <entity/entity.hpp>
+
+
+namespace ent
+{
+	// Columnar (struct-of-arrays) encoding for a vector of entities. Instead of an array of objects
+	// the output is an object containing the number of rows and an object of columns, one per
+	// field in the entity description:
+	//
+	//   { "count": 2, "fields": { "id": [ 1, 2 ], "name": [ "a", "b" ] } }
+	//
+	// With binary codecs (such as bson or msgpack) the columns for arithmetic fields are written
+	// as a single binary value containing the contiguous native (little-endian) array of that
+	// type, so they can be loaded directly or processed with vectorised loops.
+	class columnar
+	{
+		public:
+
+			template <class Codec, class T> static std::string encode(const std::vector<T> &items)
+			{
+				static_assert(std::is_base_of<codec, Codec>::value,	"Invalid codec specified");
+
+				Codec c;
+				stack<int> stack;
+				os result(Codec::oflags);
+
+				T prototype;
+				auto fields	= prototype.ent_describe();
+				auto &rows	= const_cast<std::vector<T> &>(items);	// Only ever read from
+				int i		= fields.size() - 1;
+				size_t f	= 0;
+
+				cells<T> table(rows, fields.size());
+
+				c.object_start(result, "", stack, 2);
+				c.item(result, "count", (int64_t)items.size(), stack.size());
+				c.separator(result, false);
+				c.object_start(result, "fields", stack, fields.size());
+
+				for (auto &[name, field] : fields)
+				{
+					const bool packed = packable<Codec>(prototype, *field, [&](auto sample, size_t offset) {
+						c.item(result, name, pack<decltype(sample)>(rows, offset), stack.size());
+					});
+
+					if (!packed)
+					{
+						int j = items.size() - 1;
+
+						c.array_start(result, name, stack, items.size());
+
+						for (size_t k = 0; k < items.size(); k++)
+						{
+							table.at(k, f).encode(c, result, c.array_item_name(k), stack);
+							c.separator(result, !j--);
+						}
+
+						c.array_end(result, stack);
+					}
+
+					c.separator(result, !i--);
+					f++;
+				}
+
+				c.object_end(result, stack);
+				c.object_end(result, stack);
+
+				return result.str();
+			}
+
+
+			template <class Codec, class T> static std::vector<T> decode(const std::string &data, bool skipValidation = false)
+			{
+				static_assert(std::is_base_of<codec, Codec>::value,	"Invalid codec specified");
+
+				Codec c;
+				string name;
+				int type		= -1;
+				int position	= 0;
+				bool counted	= false;
+				std::vector<T> result;
+
+				T prototype;
+				auto fields = prototype.ent_describe();
+				cells<T> table(result, fields.size());
+
+				if (!skipValidation && !c.validate(data))
+				{
+					return result;
+				}
+
+				if (c.object_start(data, position, type))
+				{
+					while (c.item(data, position, name, type))
+					{
+						if (name == "count")
+						{
+							// Every row occupies at least one byte of each column
+							const int64_t count = c.get(data, position, type, int64_t());
+
+							if (count < 0 || count > (int64_t)data.size() || counted)
+							{
+								throw std::runtime_error("Error parsing columnar data (invalid count)");
+							}
+
+							result.resize(count);
+							counted = true;
+						}
+						else if (name == "fields")
+						{
+							// The size of every column is given by the count
+							if (!counted)
+							{
+								throw std::runtime_error("Error parsing columnar data (fields found before count)");
+							}
+
+							if (c.object_start(data, position, type))
+							{
+								while (c.item(data, position, name, type))
+								{
+									auto field = fields.find(name);
+
+									if (field == fields.end())
+									{
+										c.skip(data, position, type);
+									}
+									else
+									{
+										const size_t f	= std::distance(fields.begin(), field);
+										position		= column<Codec>(c, prototype, *field->second, result, table, f, data, position, type);
+									}
+								}
+
+								c.object_end(data, position);
+							}
+							else
+							{
+								c.skip(data, position, type);
+							}
+						}
+						else
+						{
+							c.skip(data, position, type);
+						}
+					}
+
+					c.object_end(data, position);
+				}
+
+				return result;
+			}
+
+
+		private:
+
+			// The fields of every row in mapping order. Since describing an entity allocates a vref
+			// for each field, the rows are only described if a column that is not packed needs them.
+			template <class T> class cells
+			{
+				public:
+
+					cells(std::vector<T> &items, size_t fields) : items(&items), fields(fields) {}
+
+					vbase &at(size_t row, size_t field)
+					{
+						if (this->rows.size() != this->items->size())
+						{
+							this->describe();
+						}
+
+						return *this->index[row * this->fields + field];
+					}
+
+				private:
+
+					void describe()
+					{
+						this->rows.clear();
+						this->index.clear();
+						this->rows.reserve(this->items->size());
+						this->index.reserve(this->items->size() * this->fields);
+
+						for (auto &i : *this->items)
+						{
+							for (auto &[name, field] : this->rows.emplace_back(i.ent_describe()))
+							{
+								this->index.push_back(field.get());
+							}
+						}
+					}
+
+					std::vector<T> *items;
+					size_t fields;
+					std::vector<mapping> rows;
+					std::vector<vbase *> index;
+			};
+
+
+			// If the codec is binary and the field is an arithmetic member of the entity then invoke
+			// the function with a value of the field type and the offset of the field within the
+			// entity, and return true. Values held elsewhere, such as the target of a pointer, are
+			// not packed since they cannot be addressed by offset.
+			template <class Codec, class T, class F> static bool packable(T &prototype, vbase &field, F function)
+			{
+				bool result = false;
+
+				if constexpr (Codec::oflags & std::ios::binary)
+				{
+					field.modify([&](any_ref value) {
+						const auto start	= reinterpret_cast<uint8_t *>(&prototype);
+						const auto address	= static_cast<uint8_t *>(value.value);
+
+						if (address >= start && address < start + sizeof(T))
+						{
+							result = dispatch<bool, int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t, float, double>(
+								value, function, address - start
+							);
+						}
+					}, false);
+				}
+
+				return result;
+			}
+
+
+			template <typename... V, class F> static bool dispatch(any_ref &value, F &function, size_t offset)
+			{
+				return ((value.is<V>() && (function(V(), offset), true)) || ...);
+			}
+
+
+			template <typename V, class T> static vector<uint8_t> pack(std::vector<T> &items, size_t offset)
+			{
+				vector<uint8_t> result(items.size() * sizeof(V));
+				uint8_t *destination = result.data();
+
+				for (auto &i : items)
+				{
+					std::memcpy(destination, reinterpret_cast<const uint8_t *>(&i) + offset, sizeof(V));
+					destination += sizeof(V);
+				}
+
+				return result;
+			}
+
+
+			template <class Codec, class T> static int column(const Codec &c, T &prototype, vbase &field, std::vector<T> &items, cells<T> &table, size_t f, const string &data, int position, int type)
+			{
+				const bool packed = packable<Codec>(prototype, field, [&](auto sample, size_t offset) {
+					using V = decltype(sample);
+
+					const auto bytes		= c.get(data, position, type, vector<uint8_t>());
+					const uint8_t *source	= bytes.data();
+
+					if (bytes.size() != items.size() * sizeof(V))
+					{
+						throw std::runtime_error("Error parsing columnar data (invalid column length)");
+					}
+
+					for (auto &i : items)
+					{
+						uint8_t *destination = reinterpret_cast<uint8_t *>(&i) + offset;
+
+						// Any byte other than 0 or 1 would not be a valid bool
+						if constexpr (std::is_same_v<V, bool>)	*reinterpret_cast<bool *>(destination) = *source != 0;
+						else									std::memcpy(destination, source, sizeof(V));
+
+						source += sizeof(V);
+					}
+				});
+
+				if (!packed)
+				{
+					if (c.array_start(data, position, type))
+					{
+						for (size_t j = 0; c.array_item(data, position, type); j++)
+						{
+							if (j < items.size())	position = table.at(j, f).decode(c, data, position, type);
+							else					c.skip(data, position, type);
+						}
+
+						c.array_end(data, position);
+					}
+					else
+					{
+						c.skip(data, position, type);
+					}
+				}
+
+				return position;
+			}
+	};
+}
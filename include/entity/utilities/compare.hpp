@@ -31,12 +31,18 @@ namespace ent
 			}
 
 
-			// Compare two entities and document the changes. It will skip paths that exist in only one of the trees.
+			// Compare two entities and document the changes. The entities are walked in step without
+			// conversion to trees, and vectors and maps are compared element by element where the level
+			// includes the index or key. An element that exists in only one of them is documented with a
+			// null value on the other side. Trees contained by the entities are compared as above.
 			template <typename T> static std::vector<diff> entities(const T &original, const T &updated)
 			{
 				std::vector<diff> changes;
+				std::string level;
 
-				recurse("", to_tree(original), to_tree(updated), changes);
+				vref<const T>::diff(original, updated, level, [&](const std::string &level, const vbase *before, const vbase *after) {
+					changes.push_back({ level, before ? before->to_tree() : tree(nullptr), after ? after->to_tree() : tree(nullptr) });
+				});
 
 				return changes;
 			}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <entity/tree.hpp>
+#include <entity/entity.hpp>
+
+
+namespace ent
+{
+	// Deltas between two values, so that a change can be published without the full value.
+	// Patches are created from trees (entities are converted first) and are encoded with any
+	// codec. A merge patch (RFC 7386) is an object containing only the changed properties,
+	// where a null removes a property, and arrays are always replaced in full. A JSON patch
+	// (RFC 6902) is an array of add, remove and replace operations, with arrays compared
+	// element by element. Both kinds of patch can be applied to entities and trees, and JSON
+	// patches may also contain move, copy and test operations.
+	class patch
+	{
+		public:
+
+			// Create a merge patch that transforms the original into the updated tree
+			static tree merge(const tree &original, const tree &updated)
+			{
+				if (original.get_type() != tree::Type::Object || updated.get_type() != tree::Type::Object)
+				{
+					return updated;
+				}
+
+				tree result;
+
+				for (auto &[name, after] : updated.children)
+				{
+					auto before = original.children.find(name);
+
+					if (before == original.children.end())
+					{
+						result.children[name] = after;
+					}
+					else if (before->second != after)
+					{
+						result.children[name] = merge(before->second, after);
+					}
+				}
+
+				for (auto &[name, before] : original.children)
+				{
+					if (!updated.contains(name))
+					{
+						result.children[name] = nullptr;
+					}
+				}
+
+				return result;
+			}
+
+
+			template <typename T> static tree merge(const T &original, const T &updated)
+			{
+				return merge(to_tree(original), to_tree(updated));
+			}
+
+
+			// Apply a merge patch to a tree
+			static tree &apply(tree &target, const tree &patch)
+			{
+				vref<tree>::merge(target, patch);
+				return target;
+			}
+
+
+			// Apply a merge patch to an entity. The patch is converted directly into the fields that
+			// it names, where a null resets a field to its default value.
+			template <typename T> static T &apply(T &item, const tree &patch)
+			{
+				if (patch.get_type() == tree::Type::Object)
+				{
+					merging::scope merge(true);
+					vref<T>::from_tree(item, patch);
+				}
+
+				return item;
+			}
+
+
+			// Apply a list of JSON patch operations (add, remove, replace, move, copy and test) to a
+			// tree. This is not an overload of apply since a single braced operation would convert to
+			// a merge patch. The operations are applied to a copy so that the target is unchanged if any of
+			// them fail, in which case an exception is thrown.
+			static tree &apply_operations(tree &target, const std::vector<tree> &operations)
+			{
+				tree result = target;
+
+				for (auto &o : operations)
+				{
+					execute(result, o);
+				}
+
+				return target = std::move(result);
+			}
+
+
+			// Apply a list of JSON patch operations to an entity. Since an operation may address any
+			// value, the entity is converted to a tree and back in full. Converting from a tree merges
+			// into existing containers, so the result is built in a new entity which then replaces
+			// the item, allowing an operation to remove items and keys.
+			template <typename T> static T &apply_operations(T &item, const std::vector<tree> &operations)
+			{
+				tree data = to_tree(item);
+				T result;
+
+				apply_operations(data, operations);
+				from_tree(data, result);
+
+				return item = std::move(result);
+			}
+
+
+			// Create the list of JSON patch operations that transform the original into the updated tree
+			static std::vector<tree> operations(const tree &original, const tree &updated)
+			{
+				std::vector<tree> result;
+
+				operations("", original, updated, result);
+
+				return result;
+			}
+
+
+			template <typename T> static std::vector<tree> operations(const T &original, const T &updated)
+			{
+				return operations(to_tree(original), to_tree(updated));
+			}
+
+
+		private:
+
+			static void execute(tree &target, const tree &operation)
+			{
+				const auto op	= field(operation, "op").as_string();
+				const auto path	= tokens(field(operation, "path").as_string());
+
+				if (op == "add")			add(target, path, field(operation, "value"));
+				else if (op == "remove")	remove(target, path);
+				else if (op == "replace")	*existing(target, path) = field(operation, "value");
+				else if (op == "copy")		add(target, path, tree(*existing(target, tokens(field(operation, "from").as_string()))));
+				else if (op == "move")
+				{
+					const auto from = tokens(field(operation, "from").as_string());
+
+					if (from.size() < path.size() && std::equal(from.begin(), from.end(), path.begin()))
+					{
+						throw std::runtime_error("Invalid patch operation (cannot move a value into itself)");
+					}
+
+					tree value = std::move(*existing(target, from));
+
+					remove(target, from);
+					add(target, path, value);
+				}
+				else if (op == "test")
+				{
+					if (*existing(target, path) != field(operation, "value"))
+					{
+						throw std::runtime_error("Patch test failed at '" + field(operation, "path").as_string() + "'");
+					}
+				}
+				else throw std::runtime_error("Invalid patch operation '" + op + "'");
+			}
+
+
+			static const tree &field(const tree &operation, const std::string &name)
+			{
+				if (!operation.contains(name))
+				{
+					throw std::runtime_error("Invalid patch operation (missing '" + name + "')");
+				}
+
+				return operation.at(name);
+			}
+
+
+			// Split a JSON pointer (RFC 6901) into unescaped property names
+			static std::vector<std::string> tokens(const std::string &pointer)
+			{
+				std::vector<std::string> result;
+
+				if (pointer.empty()) return result;
+
+				if (pointer[0] != '/')
+				{
+					throw std::runtime_error("Invalid JSON pointer '" + pointer + "'");
+				}
+
+				for (size_t begin = 1;; begin = pointer.find('/', begin) + 1)
+				{
+					auto &token = result.emplace_back();
+
+					for (size_t i = begin; i < pointer.size() && pointer[i] != '/'; i++)
+					{
+						if (pointer[i] != '~')			token += pointer[i];
+						else if (pointer[i + 1] == '0')	token += '~', i++;
+						else if (pointer[i + 1] == '1')	token += '/', i++;
+						else throw std::runtime_error("Invalid JSON pointer '" + pointer + "'");
+					}
+
+					if (pointer.find('/', begin) == std::string::npos) break;
+				}
+
+				return result;
+			}
+
+
+			// The index of an array item, which is the size of the array for "-" if appending
+			static size_t index(const std::string &token, size_t size, bool append)
+			{
+				if (append && token == "-") return size;
+
+				const bool valid = !token.empty() && token.size() < 10
+					&& std::all_of(token.begin(), token.end(), [](char c) { return c >= '0' && c <= '9'; })
+					&& (token == "0" || token[0] != '0');
+
+				const size_t result = valid ? std::stoul(token) : size + 1;
+
+				if (result > size || (result == size && !append))
+				{
+					throw std::runtime_error("Invalid patch operation (array index '" + token + "' is out of range)");
+				}
+
+				return result;
+			}
+
+
+			// The value found at the first count tokens of the path, which must exist
+			static tree *existing(tree &target, const std::vector<std::string> &path, size_t count)
+			{
+				tree *node = &target;
+
+				for (size_t i = 0; i < count; i++)
+				{
+					auto &token = path[i];
+
+					if (node->get_type() == tree::Type::Array)
+					{
+						auto &items	= node->as_array();
+						node		= &items[index(token, items.size(), false)];
+					}
+					else if (node->get_type() == tree::Type::Object && node->contains(token))
+					{
+						node = &node->at(token);
+					}
+					else
+					{
+						throw std::runtime_error("Invalid patch operation (path '" + token + "' not found)");
+					}
+				}
+
+				return node;
+			}
+
+
+			static tree *existing(tree &target, const std::vector<std::string> &path)
+			{
+				return existing(target, path, path.size());
+			}
+
+
+			static void add(tree &target, const std::vector<std::string> &path, const tree &value)
+			{
+				if (path.empty())
+				{
+					target = value;
+					return;
+				}
+
+				tree *parent	= existing(target, path, path.size() - 1);
+				auto &name		= path.back();
+
+				if (parent->get_type() == tree::Type::Array)
+				{
+					auto &items = parent->as_array();
+					items.insert(items.begin() + index(name, items.size(), true), value);
+				}
+				else if (parent->get_type() == tree::Type::Object)
+				{
+					parent->set(name, value);
+				}
+				else
+				{
+					throw std::runtime_error("Invalid patch operation (cannot add to a value)");
+				}
+			}
+
+
+			static void remove(tree &target, const std::vector<std::string> &path)
+			{
+				if (path.empty())
+				{
+					throw std::runtime_error("Invalid patch operation (cannot remove the document)");
+				}
+
+				tree *parent	= existing(target, path, path.size() - 1);
+				auto &name		= path.back();
+
+				if (parent->get_type() == tree::Type::Array)
+				{
+					auto &items = parent->as_array();
+					items.erase(items.begin() + index(name, items.size(), false));
+				}
+				else if (parent->get_type() == tree::Type::Object && parent->contains(name))
+				{
+					parent->erase(name);
+				}
+				else
+				{
+					throw std::runtime_error("Invalid patch operation (path '" + name + "' not found)");
+				}
+			}
+
+
+			static tree operation(const std::string &op, const std::string &path)
+			{
+				return tree().set("op", op).set("path", path);
+			}
+
+
+			static tree operation(const std::string &op, const std::string &path, const tree &value)
+			{
+				return operation(op, path).set("value", value);
+			}
+
+
+			// Property names are escaped as required by JSON pointers (RFC 6901)
+			static std::string pointer(const std::string &path, const std::string &name)
+			{
+				std::string result = path + "/";
+
+				for (char c : name)
+				{
+					if (c == '~')		result += "~0";
+					else if (c == '/')	result += "~1";
+					else				result += c;
+				}
+
+				return result;
+			}
+
+
+			static void operations(const std::string &path, const tree &before, const tree &after, std::vector<tree> &result)
+			{
+				const auto type = before.get_type();
+
+				if (type == tree::Type::Object && after.get_type() == tree::Type::Object)
+				{
+					for (auto &[name, b] : before.children)
+					{
+						if (after.contains(name))	operations(pointer(path, name), b, after.at(name), result);
+						else						result.push_back(operation("remove", pointer(path, name)));
+					}
+
+					for (auto &[name, a] : after.children)
+					{
+						if (!before.contains(name)) result.push_back(operation("add", pointer(path, name), a));
+					}
+				}
+				else if (type == tree::Type::Array && after.get_type() == tree::Type::Array)
+				{
+					auto &b				= before.as_array();
+					auto &a				= after.as_array();
+					const size_t common	= std::min(b.size(), a.size());
+
+					for (size_t i = 0; i < common; i++)		operations(path + "/" + std::to_string(i), b[i], a[i], result);
+					for (size_t i = common; i < a.size(); i++)	result.push_back(operation("add", path + "/" + std::to_string(i), a[i]));
+
+					// Removed in reverse so that the index of each remaining item is unchanged
+					for (size_t i = b.size(); i > common; i--)	result.push_back(operation("remove", path + "/" + std::to_string(i - 1)));
+				}
+				else if (before != after)
+				{
+					result.push_back(operation("replace", path, after));
+				}
+			}
+	};
+
+
+	// Encode a merge patch between two entities or trees. With json this is an RFC 7386 document
+	// and with bson (or another codec) the equivalent object.
+	template <class Codec, class T> std::string merge_patch(const T &original, const T &updated)
+	{
+		return encode<Codec>(patch::merge(original, updated));
+	}
+
+
+	// Encode the RFC 6902 operations between two entities or trees. The result is an array, so the
+	// codec must support arrays at the top level.
+	template <class Codec, class T> std::string json_patch(const T &original, const T &updated)
+	{
+		return encode<Codec>(tree(patch::operations(original, updated)));
+	}
+
+
+	// Update an entity (or tree) in place from an encoded merge patch. The patch is decoded directly
+	// into the fields that it names, so it is not supported by positional codecs.
+	template <class Codec, class T> T &apply_patch(const std::string &data, T &item, bool skipValidation = false)
+	{
+		static_assert(std::is_base_of<codec, Codec>::value,	"Invalid codec specified");
+
+		Codec c;
+
+		if (c.positional())
+		{
+			throw std::runtime_error("Merge patches are not supported by positional codecs");
+		}
+
+		merging::scope merge(true);
+
+		if (skipValidation || c.validate(data))
+		{
+			vref<T>::decode(item, c, data, 0, -1);
+		}
+
+		return item;
+	}
+
+
+	// Update an entity (or tree) in place from an encoded list of JSON patch operations
+	template <class Codec, class T> T &apply_json_patch(const std::string &data, T &item)
+	{
+		return patch::apply_operations(item, decode<Codec>(data).as_array());
+	}
+}
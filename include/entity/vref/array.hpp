@@ -27,7 +27,7 @@ namespace ent
 			int j = item.size() - 1;
 			int k = 0;
 
-			c.array_start(dst, name, stack);
+			c.array_start(dst, name, stack, item.size());
 
 			for (auto &i : item)
 			{
@@ -49,6 +49,8 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
+				merging::scope complete(false);
+
 				if (c.array_start(data, position, type))
 				{
 					for (int i=0; c.array_item(data, position, type); i++)
@@ -75,16 +77,31 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		void signature(string &dst) const override
 		{
-			return is_circular(*this->reference, ancestor);
+			type_signature(dst);
 		}
 
-		static bool is_circular(T &item, void *ancestor)
+		static void type_signature(string &dst)
 		{
-			return std::any_of(item.begin(), item.end(), [=](auto &v) {
-				return vref<const typename T::value_type>::is_circular(v, ancestor);
-			});
+			dst += '[';
+			vref<const typename T::value_type>::type_signature(dst);
+			dst += ';' + std::to_string(std::tuple_size_v<std::remove_const_t<T>>) + ']';
+		}
+
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
+		{
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
+		}
+
+		static void diff(T &before, T &after, string &level, const reporter &report)
+		{
+			for (size_t i = 0; i < before.size(); i++)
+			{
+				nested n(level, std::to_string(i));
+				vref<const typename T::value_type>::diff(before[i], after[i], level, report);
+			}
 		}
 
 
@@ -109,6 +126,8 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
+				merging::scope complete(false);
+
 				if (data.get_type() == tree::Type::Array)
 				{
 					int i = 0;
@@ -2,6 +2,8 @@
 
 #include <entity/any.hpp>
 #include <entity/codec.hpp>
+#include <entity/vref/resource.hpp>
+#include <entity/vref/merging.hpp>
 #include <stack>
 #include <map>
 
@@ -27,7 +29,39 @@ namespace ent
 		virtual void modify(std::function<void(any_ref)> modifier, const bool recurse = true) = 0;
 
 
-		virtual bool is_circular(void *) const = 0;
+		// Append a description of the type of the value, which includes the names and types of
+		// entity fields and the element types of containers, but not the value itself. Positional
+		// codecs use this to detect a mismatch between the writer and reader (see compact).
+		virtual void signature(std::string &dst) const = 0;
+
+
+		// Report the differences between this and another reference to a value of the same type.
+		// The function is invoked with the level (path) and both values for each difference, where
+		// an element that exists on only one side is reported against a nullptr. The level is used
+		// as a buffer while descending so that it is only copied for reported differences.
+		using reporter = std::function<void(const std::string &level, const vbase *before, const vbase *after)>;
+
+		virtual void diff(const vbase &other, std::string &level, const reporter &report) const = 0;
+
+
+		// Appends a name to the level for the lifetime of the scope
+		class nested
+		{
+			public:
+
+				nested(std::string &level, const std::string &name) : level(level), length(level.size())
+				{
+					if (length) level += ':';
+					level += name;
+				}
+
+				~nested() { this->level.resize(this->length); }
+
+			private:
+
+				std::string &level;
+				size_t length;
+		};
 	};
 
 	// Structure for storing the entity description
@@ -39,6 +73,17 @@ namespace ent
 	template <typename T, typename enable=void> struct vref { static_assert(fail<T>::value, "Item must contain a description and have a default constructor, have you missed a public 'emap()' definition in your entity?"); };
 
 
+	// Report a difference between two values that are compared as a whole
+	template <typename T> void diff_value(T &before, T &after, const std::string &level, const vbase::reporter &report)
+	{
+		if (before != after)
+		{
+			vref<T> b(before), a(after);
+			report(level, &b, &a);
+		}
+	}
+
+
 	template <typename T> inline constexpr bool is_not_const = !std::is_const<T>::value;
 
 	// Helper functions to create a vref with automatic type detection
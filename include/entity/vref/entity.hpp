@@ -1,5 +1,6 @@
 #pragma once
 #include <entity/vref/base.hpp>
+#include <entity/projection.hpp>
 
 
 namespace ent
@@ -23,8 +24,29 @@ namespace ent
 		{
 			auto map	= item.ent_describe();
 			int i		= map.size() - 1;
+			int j		= 0;
 
-			c.object_start(dst, name, stack);
+			if (c.positional())
+			{
+				c.array_start(dst, name, stack, map.size());
+
+				for (auto &[k, v] : map)
+				{
+					v->encode(c, dst, c.array_item_name(j++), stack);
+					c.separator(dst, !i--);
+				}
+
+				c.array_end(dst, stack);
+				return;
+			}
+
+			if (projection::active() || encoding::omitting())
+			{
+				encode_selected(map, c, dst, name, stack);
+				return;
+			}
+
+			c.object_start(dst, name, stack, map.size());
 
 			//for (auto &v : map.lookup)
 			for (auto &[k, v] : map)
@@ -37,6 +59,64 @@ namespace ent
 		}
 
 
+		// Only the fields selected by the active projection are written and, if required, those
+		// equal to the value declared by the entity are omitted. Since a default constructed entity
+		// holds the declared values, each field is compared with the same field of one of those.
+		static void encode_selected(mapping &map, const codec &c, os &dst, const string &name, stack<int> &stack)
+		{
+			std::vector<std::pair<mapping::value_type *, const projection *>> fields;
+
+			auto scope		= projection::active();
+			const bool omit	= encoding::omitting();
+			auto original	= omit ? defaults().begin() : mapping::const_iterator();
+
+			// A single reporter is shared by every field, which has changed if it is invoked
+			string level;
+			bool changed = false;
+			const vbase::reporter report = [&](const string &, const vbase *, const vbase *) { changed = true; };
+
+			for (auto &field : map)
+			{
+				auto selected = scope ? scope->field(field.first) : nullptr;
+
+				if (selected || !scope)
+				{
+					changed = !omit;
+
+					if (omit)		field.second->diff(*original->second, level, report);
+					if (changed)	fields.emplace_back(&field, selected);
+				}
+
+				if (omit) original++;
+			}
+
+			int i = fields.size() - 1;
+
+			c.object_start(dst, name, stack, fields.size());
+
+			for (auto &[field, selected] : fields)
+			{
+				projection::scope inner(selected);
+
+				field->second->encode(c, dst, field->first, stack);
+				c.separator(dst, !i--);
+			}
+
+			c.object_end(dst, stack);
+		}
+
+
+		// The description of an entity that is default constructed once per type and thread,
+		// so that omitting defaults does not construct one for every entity that is encoded
+		static const mapping &defaults()
+		{
+			thread_local T item{};
+			thread_local const mapping result = item.ent_describe();
+
+			return result;
+		}
+
+
 		int decode(const codec &c, const string &data, int position, int type) override
 		{
 			return decode(*this->reference, c, data, position, type);
@@ -50,13 +130,38 @@ namespace ent
 				auto map 			= item.ent_describe();
 				std::string name	= "";
 
+				if (c.positional())
+				{
+					return decode_positional(map, c, data, position, type);
+				}
+
 				if (c.object_start(data, position, type))
 				{
+					// The encoders write fields in mapping order, so the next field is normally found at the
+					// cursor without a search. Items that arrive out of order fall back to a single lookup.
+					auto cursor	= map.begin();
+					auto scope	= projection::active();
+
 					while (c.item(data, position, name, type))
 					{
-						if (map.count(name))
+						auto field		= cursor != map.end() && cursor->first == name ? cursor : map.find(name);
+						auto selected	= scope ? scope->field(name) : nullptr;
+
+						if (field != map.end() && (selected || !scope))
 						{
-							position = map[name]->decode(c, data, position, type);
+							projection::scope inner(selected);
+
+							if (merging::active() && c.is_null(data, position, type))
+							{
+								reset(field->first, *field->second);
+								c.skip(data, position, type);
+							}
+							else
+							{
+								position = field->second->decode(c, data, position, type);
+							}
+
+							cursor = std::next(field);
 						}
 						else
 						{
@@ -80,22 +185,113 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		// Fields are read in mapping order, any additional items are skipped
+		static int decode_positional(mapping &map, const codec &c, const string &data, int position, int type)
 		{
-			return is_circular(*this->reference, ancestor);
+			if (c.array_start(data, position, type))
+			{
+				auto field	= map.begin();
+				auto scope	= projection::active();
+
+				while (c.array_item(data, position, type))
+				{
+					auto selected = scope && field != map.end() ? scope->field(field->first) : nullptr;
+
+					if (field != map.end() && (selected || !scope))
+					{
+						projection::scope inner(selected);
+
+						position = field->second->decode(c, data, position, type);
+					}
+					else
+					{
+						c.skip(data, position, type);
+					}
+
+					if (field != map.end()) field++;
+				}
+
+				c.array_end(data, position);
+			}
+			else
+			{
+				c.skip(data, position, type);
+			}
+
+			return position;
+		}
+
+
+		// A null in a merge patch resets the field to the default value declared by the entity
+		static void reset(const string &name, vbase &field)
+		{
+			merging::scope complete(false);
+			T defaults;
+
+			field.from_tree(defaults.ent_describe().at(name)->to_tree());
+		}
+
+
+		void signature(string &dst) const override
+		{
+			type_signature(dst);
 		}
 
-		static bool is_circular(T &item, void *ancestor)
+		// The field names and types of a default constructed entity. An entity that contains
+		// itself, through a pointer or container, is only expanded at the outermost level.
+		static void type_signature(string &dst)
 		{
-			for (const auto &[k,v] : item.ent_describe())
+			using V = std::remove_const_t<T>;
+
+			if constexpr (std::is_const_v<T>)
+			{
+				vref<V>::type_signature(dst);
+			}
+			else
 			{
-				if (v->is_circular(ancestor))
+				thread_local bool expanding = false;
+
+				if (expanding)
+				{
+					dst += '^';
+					return;
+				}
+
+				V item;
+				auto map	= item.ent_describe();
+				expanding	= true;
+
+				dst += '(';
+
+				for (auto &[k, v] : map)
 				{
-					return true;
+					dst += k + ':';
+					v->signature(dst);
+					dst += ',';
 				}
+
+				dst += ')';
+				expanding = false;
 			}
+		}
 
-			return false;
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
+		{
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
+		}
+
+		// Both mappings describe the same type so their fields are walked in step
+		static void diff(T &before, T &after, string &level, const reporter &report)
+		{
+			auto b = before.ent_describe();
+			auto a = after.ent_describe();
+
+			for (auto i = b.begin(), j = a.begin(); i != b.end(); i++, j++)
+			{
+				nested n(level, i->first);
+				i->second->diff(*j->second, level, report);
+			}
 		}
 
 
@@ -120,11 +316,21 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
-				for (auto &[k, v] : item.ent_describe())
+				// Both the mapping and the tree children are sorted by name so they are walked in step
+				auto map	= item.ent_describe();
+				auto child	= data.children.begin();
+				auto end	= data.children.end();
+
+				for (auto &[k, v] : map)
 				{
-					if (data.contains(k))
+					while (child != end && child->first < k) child++;
+
+					if (child != end && child->first == k)
 					{
-						v->from_tree(data.at(k));
+						if (merging::active() && child->second.null())	reset(k, *v);
+						else											v->from_tree(child->second);
+
+						child++;
 					}
 				}
 			}
@@ -41,8 +41,10 @@ namespace ent
 		};
 
 
-		bool is_circular(void *) const override				{ return false; }
-		static bool is_circular(T &, void *)				{ return false; }
+		void signature(string &dst) const override			{ type_signature(dst); }
+		static void type_signature(string &dst)				{ dst += 'e'; vref<std::underlying_type_t<std::remove_const_t<T>>>::type_signature(dst); }
+		void diff(const vbase &other, string &level, const reporter &report) const override	{ diff(*this->reference, *static_cast<const vref &>(other).reference, level, report); }
+		static void diff(T &before, T &after, string &level, const reporter &report)		{ diff_value(before, after, level, report); }
 		tree to_tree() const override 						{ return (int)*this->reference; }
 		void from_tree(const tree &data) override			{ return from_tree(*this->reference, data); } //*this->reference = (T)data.as_long(); }
 		static tree to_tree(T &item)						{ return (int)item; }
@@ -2,19 +2,23 @@
 #include <entity/vref/base.hpp>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 
 
 namespace ent
 {
-	template <typename T> using if_map = typename std::enable_if_t<std::is_same_v<
-		std::map<string, typename T::mapped_type>,
-		std::remove_const_t<T>
-	>>;
+	template <typename T> using if_map = typename std::enable_if_t<
+		   std::is_same_v<std::map<string, typename T::mapped_type, std::less<string>, typename T::allocator_type>, std::remove_const_t<T>>
+		|| std::is_same_v<std::unordered_map<string, typename T::mapped_type, std::hash<string>, std::equal_to<string>, typename T::allocator_type>, std::remove_const_t<T>>
+	>;
 
 
-	// Reference to std::map
+	// Reference to std::map or std::unordered_map with string keys, the latter is encoded in
+	// iteration order
 	template <class T> struct vref<T, if_map<T>> : vbase
 	{
+		static constexpr bool ordered = std::is_same_v<std::map<string, typename T::mapped_type, std::less<string>, typename T::allocator_type>, std::remove_const_t<T>>;
+
 		vref(T &reference) : reference(&reference) {}
 		// vref(const T &reference) : reference(&reference) {}
 
@@ -29,7 +33,7 @@ namespace ent
 		{
 			int j = item.size() - 1;
 
-			c.object_start(dst, name, stack);
+			c.object_start(dst, name, stack, item.size());
 
 			for (auto &[k, v] : item)
 			{
@@ -52,12 +56,43 @@ namespace ent
 			if constexpr (is_not_const<T>)
 			{
 				string name = "";
+				resource::adopt(item);
 
 				if (c.object_start(data, position, type))
 				{
-					while (c.item(data, position, name, type))
+					if (merging::active())
+					{
+						// A patch is merged into the existing contents where a null removes the key
+						while (c.item(data, position, name, type))
+						{
+							if (c.is_null(data, position, type))
+							{
+								item.erase(name);
+								c.skip(data, position, type);
+							}
+							else
+							{
+								position = vref<typename T::mapped_type>::decode(item[name], c, data, position, type);
+							}
+						}
+					}
+					else
 					{
-						position = vref<typename T::mapped_type>::decode(item[name], c, data, position, type);
+						if constexpr (!ordered)
+						{
+							if (const auto size = c.size_hint(data, position); size > 0) item.reserve(item.size() + size);
+						}
+
+						// Keys of an ordered map are encoded in order so each one normally belongs immediately
+						// before the item following the previous key, which makes the insertion constant time
+						auto hint = item.begin();
+
+						while (c.item(data, position, name, type))
+						{
+							auto entry	= item.try_emplace(hint, name);
+							position	= vref<typename T::mapped_type>::decode(entry->second, c, data, position, type);
+							hint		= std::next(entry);
+						}
 					}
 
 					c.object_end(data, position);
@@ -76,16 +111,89 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		void signature(string &dst) const override	{ type_signature(dst); }
+		static void type_signature(string &dst)
+		{
+			dst += '{';
+			vref<const typename T::mapped_type>::type_signature(dst);
+			dst += '}';
+		}
+
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
+		{
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
+		}
+
+		// Both maps are sorted by key so they are walked in step
+		static void diff(T &before, T &after, string &level, const reporter &report)
 		{
-			return is_circular(*this->reference, ancestor);
+			using V = const typename T::mapped_type;
+
+			if constexpr (!ordered)
+			{
+				diff_unordered(before, after, level, report);
+				return;
+			}
+
+			auto b = before.begin();
+			auto a = after.begin();
+
+			while (b != before.end() || a != after.end())
+			{
+				if (a == after.end() || (b != before.end() && b->first < a->first))
+				{
+					nested n(level, b->first);
+					vref<V> v(b->second);
+					report(level, &v, nullptr);
+					b++;
+				}
+				else if (b == before.end() || a->first < b->first)
+				{
+					nested n(level, a->first);
+					vref<V> v(a->second);
+					report(level, nullptr, &v);
+					a++;
+				}
+				else
+				{
+					nested n(level, b->first);
+					vref<V>::diff((b++)->second, (a++)->second, level, report);
+				}
+			}
 		}
 
-		static bool is_circular(T &item, void *ancestor)
+
+		// Keys are looked up in the other map instead
+		static void diff_unordered(T &before, T &after, string &level, const reporter &report)
 		{
-			return std::any_of(item.begin(), item.end(), [=](auto &v) {
-				return vref<const typename T::mapped_type>::is_circular(v.second, ancestor);
-			});
+			using V = const typename T::mapped_type;
+
+			for (auto &[k, v] : before)
+			{
+				nested n(level, k);
+				auto a = after.find(k);
+
+				if (a == after.end())
+				{
+					vref<V> b(v);
+					report(level, &b, nullptr);
+				}
+				else
+				{
+					vref<V>::diff(v, a->second, level, report);
+				}
+			}
+
+			for (auto &[k, v] : after)
+			{
+				if (!before.count(k))
+				{
+					nested n(level, k);
+					vref<V> a(v);
+					report(level, nullptr, &a);
+				}
+			}
 		}
 
 
@@ -127,9 +235,13 @@ namespace ent
 			}
 			else
 			{
+				// In a merge patch a null removes the key
+				const bool merge = merging::active();
+
 				for (auto &[k, v] : data.children)
 				{
-					vref<typename T::mapped_type>::from_tree(item[k], v);
+					if (merge && v.null())	item.erase(k);
+					else					vref<typename T::mapped_type>::from_tree(item[k], v);
 				}
 			}
 
@@ -0,0 +1,38 @@
+#pragma once
+
+
+namespace ent
+{
+	// Whether the data being decoded (or converted from a tree) on this thread is a merge patch
+	// (RFC 7386) rather than a complete value. Objects are then merged into the existing item,
+	// so fields and keys that are absent are left untouched and a null resets a field to its
+	// default value or removes a key. Arrays are always replaced in full, and their items are
+	// complete values rather than patches.
+	class merging
+	{
+		public:
+
+			static bool &active()
+			{
+				thread_local bool current = false;
+				return current;
+			}
+
+
+			// Sets the mode for the lifetime of the scope, restoring the previous one afterwards
+			class scope
+			{
+				public:
+
+					scope(bool merge) : previous(active())	{ active() = merge; }
+					~scope()								{ active() = this->previous; }
+
+					scope(const scope &) = delete;
+					scope &operator=(const scope &) = delete;
+
+				private:
+
+					bool previous;
+			};
+	};
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <entity/vref/base.hpp>
+#include <optional>
+
+
+namespace ent
+{
+	template <typename T> using if_optional = typename std::enable_if_t<
+		std::is_same_v<std::remove_const_t<T>, std::optional<typename T::value_type>>
+	>;
+
+
+	// Reference to std::optional, which is encoded as null when empty. Unlike a pointer the
+	// value is held in place so an optional field does not require an allocation.
+	template <class T> struct vref<T, if_optional<T>> : vbase
+	{
+		// The value of a const optional is also const
+		using E = std::conditional_t<std::is_const_v<T>, const typename T::value_type, typename T::value_type>;
+
+		vref(T &reference) : reference(&reference) {}
+
+
+		void encode(const codec &c, os &dst, const string &name, stack<int> &stack) const override
+		{
+			encode(*this->reference, c, dst, name, stack);
+		}
+
+
+		static void encode(T &item, const codec &c, os &dst, const string &name, stack<int> &stack)
+		{
+			if (item)
+			{
+				vref<E>::encode(*item, c, dst, name, stack);
+			}
+			else
+			{
+				c.item(dst, name, stack.size()); // null
+			}
+		}
+
+
+		int decode(const codec &c, const string &data, int position, int type) override
+		{
+			return decode(*this->reference, c, data, position, type);
+		}
+
+
+		static int decode(T &item, const codec &c, const string &data, int position, int type)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				if (c.is_null(data, position, type))
+				{
+					item.reset();
+					c.skip(data, position, type);
+				}
+				else
+				{
+					// If the item already has a value then decode into it, otherwise construct in place
+					position = vref<E>::decode(item ? *item : item.emplace(), c, data, position, type);
+				}
+			}
+			else
+			{
+				c.skip(data, position, type);
+			}
+
+			return position;
+		}
+
+
+		void signature(string &dst) const override	{ type_signature(dst); }
+		static void type_signature(string &dst)		{ dst += '?'; vref<const typename T::value_type>::type_signature(dst); }
+
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
+		{
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
+		}
+
+		static void diff(T &before, T &after, string &level, const reporter &report)
+		{
+			if (before && after)
+			{
+				vref<const typename T::value_type>::diff(*before, *after, level, report);
+			}
+			else if (before || after)
+			{
+				vref<T> b(before), a(after);
+				report(level, &b, &a);
+			}
+		}
+
+
+		tree to_tree() const override				{ return to_tree(*this->reference); }
+		void from_tree(const tree &data) override	{ from_tree(*this->reference, data); }
+
+
+		static tree to_tree(T &item)
+		{
+			return item ? vref<E>::to_tree(*item) : tree(nullptr);
+		}
+
+
+		static void from_tree(T &item, const tree &data)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				if (data.null())
+				{
+					item.reset();
+				}
+				else
+				{
+					vref<E>::from_tree(item ? *item : item.emplace(), data);
+				}
+			}
+		}
+
+
+		void modify(std::function<void(any_ref)> modifier, const bool recurse = true) override
+		{
+			if constexpr (is_not_const<T>)
+			{
+				modify(*this->reference, modifier, recurse);
+			}
+		}
+
+
+		static void modify(T &item, std::function<void(any_ref)> modifier, const bool recurse = true)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				// Like a container, the optional itself is passed unless recursing
+				if (!recurse)
+				{
+					modifier(item);
+				}
+				else if (item)
+				{
+					vref<E>::modify(*item, modifier, recurse);
+				}
+			}
+		}
+
+
+		T *reference;
+	};
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <entity/vref/base.hpp>
+#include <unordered_set>
 
 
 namespace ent
@@ -10,10 +11,46 @@ namespace ent
 	>;
 
 
+	// Marks the target of a pointer as active while it is being traversed on this thread. A
+	// circular reference is found when a target is reached again while it is still active, which
+	// costs constant time per pointer rather than a walk of the entire subtree beneath it.
+	class traversal
+	{
+		public:
+
+			traversal(const void *target) : target(target), inserted(active().insert(target).second) {}
+
+			~traversal()
+			{
+				if (this->inserted) active().erase(this->target);
+			}
+
+			traversal(const traversal &) = delete;
+			traversal &operator=(const traversal &) = delete;
+
+			bool circular() const { return !this->inserted; }
+
+		private:
+
+			static std::unordered_set<const void *> &active()
+			{
+				thread_local std::unordered_set<const void *> targets;
+				return targets;
+			}
+
+			const void *target;
+			bool inserted;
+	};
+
+
 
 	// Reference to smart pointers
 	template <class T> struct vref<T, if_pointer<T>> : vbase
 	{
+		using E = typename T::element_type;
+
+		static constexpr bool shared = std::is_same_v<std::remove_const_t<T>, std::shared_ptr<E>>;
+
 		vref(T &reference) : reference(&reference) {}
 
 
@@ -25,9 +62,20 @@ namespace ent
 
 		static void encode(T &item, const codec &c, os &dst, const string &name, stack<int> &stack)
 		{
+			if constexpr (shared)
+			{
+				if (item && c.tracker())
+				{
+					encode_tracked(item, c, dst, name, stack);
+					return;
+				}
+			}
+
 			if (item)
 			{
-				if (vref<const typename T::element_type>::is_circular(*item, item.get()))
+				traversal guard(item.get());
+
+				if (guard.circular())
 				{
 					throw std::runtime_error(
 						"Circular reference found back to '" + name + "', aborting encode"
@@ -43,6 +91,33 @@ namespace ent
 		}
 
 
+		// The first occurrence of an object is written with an identifier and any later ones as a
+		// reference to it. Since a reference does not recurse, circular references are permitted.
+		// Objects are identified by type as well as address, since an aliasing pointer (such as
+		// one to the first member of another object) may share the address of a different type.
+		static void encode_tracked(T &item, const codec &c, os &dst, const string &name, stack<int> &stack)
+		{
+			auto &ids				= c.tracker()->ids;
+			auto [id, inserted]		= ids.try_emplace({ item.get(), typeid(E) }, ids.size() + 1);
+
+			c.object_start(dst, name, stack, inserted ? 2 : 1);
+
+			if (inserted)
+			{
+				c.item(dst, "$id", (int32_t)id->second, stack.size());
+				c.separator(dst, false);
+				vref<E>::encode(*item, c, dst, "$value", stack);
+			}
+			else
+			{
+				c.item(dst, "$ref", (int32_t)id->second, stack.size());
+			}
+
+			c.separator(dst, true);
+			c.object_end(dst, stack);
+		}
+
+
 		int decode(const codec &c, const string &data, int position, int type) override
 		{
 			return decode(*this->reference, c, data, position, type);
@@ -55,6 +130,10 @@ namespace ent
 			{
 				return std::make_unique<typename T::element_type>();
 			}
+			else if (auto r = resource::active())
+			{
+				return std::allocate_shared<typename T::element_type>(std::pmr::polymorphic_allocator<typename T::element_type>(r));
+			}
 			else
 			{
 				return std::make_shared<typename T::element_type>();
@@ -71,9 +150,15 @@ namespace ent
 					item = nullptr;
 					c.skip(data, position, type);
 				}
+				else if (shared && c.tracker())
+				{
+					position = decode_tracked(item, c, data, position, type);
+				}
 				else if (item)
 				{
-					if (vref<const typename T::element_type>::is_circular(*item, item.get()))
+					traversal guard(item.get());
+
+					if (guard.circular())
 					{
 						throw std::runtime_error("Circular reference found aborting decode");
 					}
@@ -97,14 +182,82 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		// An object is always created for an identifier, rather than decoding into an existing
+		// one, so that every reference to it shares ownership
+		static int decode_tracked(T &item, const codec &c, const string &data, int position, int type)
 		{
-			return is_circular(*this->reference, ancestor);
+			if constexpr (shared && is_not_const<T>)
+			{
+				auto &objects	= c.tracker()->objects;
+				int id			= 0;
+				string name;
+
+				if (c.object_start(data, position, type))
+				{
+					while (c.item(data, position, name, type))
+					{
+						if (name == "$id")
+						{
+							id = c.get(data, position, type, (int32_t)0);
+						}
+						else if (name == "$ref")
+						{
+							auto object = objects.find(c.get(data, position, type, (int32_t)0));
+
+							if (object == objects.end() || *object->second.second != typeid(E))
+							{
+								throw std::runtime_error("Invalid shared reference found aborting decode");
+							}
+
+							item = std::static_pointer_cast<E>(object->second.first);
+						}
+						else if (name == "$value")
+						{
+							// Registered before decoding the value so that it may contain references to itself
+							item = make_pointer();
+
+							if (id) objects[id] = { item, &typeid(E) };
+
+							position = vref<E>::decode(*item, c, data, position, type);
+						}
+						else
+						{
+							c.skip(data, position, type);
+						}
+					}
+
+					c.object_end(data, position);
+				}
+				else
+				{
+					c.skip(data, position, type);
+				}
+			}
+
+			return position;
+		}
+
+
+		void signature(string &dst) const override	{ type_signature(dst); }
+		static void type_signature(string &dst)		{ dst += '*'; vref<const typename T::element_type>::type_signature(dst); }
+
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
+		{
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
 		}
 
-		static bool is_circular(T &item, void *ancestor)
+		static void diff(T &before, T &after, string &level, const reporter &report)
 		{
-			return item && (item.get() == ancestor || vref<typename T::element_type>::is_circular(*item, ancestor));
+			if (before && after)
+			{
+				vref<const typename T::element_type>::diff(*before, *after, level, report);
+			}
+			else if (before || after)
+			{
+				vref<T> b(before), a(after);
+				report(level, &b, &a);
+			}
 		}
 
 
@@ -135,12 +288,13 @@ namespace ent
 				}
 				else if (item)
 				{
-					if (vref<const typename T::element_type>::is_circular(*item, item.get()))
+					traversal guard(item.get());
+
+					if (guard.circular())
 					{
 						throw std::runtime_error("Circular reference found aborting from_tree");
 					}
 
-
 					vref<typename T::element_type>::from_tree(*item, data);
 				}
 				else
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+
+
+namespace ent
+{
+	template <typename T, typename enable = void> struct is_polymorphic_allocated : std::false_type {};
+	template <typename T> struct is_polymorphic_allocated<T, std::void_t<typename T::allocator_type>> : std::is_same<
+		typename T::allocator_type, std::pmr::polymorphic_allocator<typename T::value_type>
+	> {};
+
+
+	// The memory resource used for objects created while decoding on this thread, which allows an
+	// entire decoded message to live in a single arena such as a std::pmr::monotonic_buffer_resource
+	class resource
+	{
+		public:
+
+			static std::pmr::memory_resource *&active()
+			{
+				thread_local std::pmr::memory_resource *current = nullptr;
+				return current;
+			}
+
+
+			// Moves an empty std::pmr container or string that is still using the default resource
+			// onto the active resource, so that the items decoded into it are allocated there
+			template <class T> static void adopt(T &item)
+			{
+				if constexpr (is_polymorphic_allocated<T>::value)
+				{
+					auto r = active();
+
+					if (r && item.empty() && item.get_allocator().resource() == std::pmr::get_default_resource())
+					{
+						std::destroy_at(&item);
+						std::construct_at(&item, r);
+					}
+				}
+			}
+
+
+			// Applies a resource for the lifetime of the scope, restoring the previous one afterwards
+			class scope
+			{
+				public:
+
+					scope(std::pmr::memory_resource *r) : previous(active())	{ active() = r; }
+					~scope()													{ active() = this->previous; }
+
+					scope(const scope &) = delete;
+					scope &operator=(const scope &) = delete;
+
+				private:
+
+					std::pmr::memory_resource *previous;
+			};
+	};
+}
@@ -2,18 +2,22 @@
 #include <entity/vref/base.hpp>
 #include <algorithm>
 #include <set>
+#include <unordered_set>
 
 
 namespace ent
 {
-	template <typename T> using if_set = typename std::enable_if_t<std::is_same_v<
-		std::set<typename T::value_type>,
-		std::remove_const_t<T>
-	>>;
+	template <typename T> using if_set = typename std::enable_if_t<
+		   std::is_same_v<std::set<typename T::value_type, std::less<typename T::value_type>, typename T::allocator_type>, std::remove_const_t<T>>
+		|| std::is_same_v<std::unordered_set<typename T::value_type, std::hash<typename T::value_type>, std::equal_to<typename T::value_type>, typename T::allocator_type>, std::remove_const_t<T>>
+	>;
 
 
+	// Reference to std::set or std::unordered_set, the latter is encoded in iteration order
 	template <class T> struct vref<T, if_set<T>> : vbase
 	{
+		static constexpr bool ordered = std::is_same_v<std::set<typename T::value_type, std::less<typename T::value_type>, typename T::allocator_type>, std::remove_const_t<T>>;
+
 		vref(T &reference) : reference(&reference) {}
 		// vref(const T &reference) : reference(&reference) {}
 
@@ -29,7 +33,7 @@ namespace ent
 			int j = item.size() - 1;
 			int k = 0;
 
-			c.array_start(dst, name, stack);
+			c.array_start(dst, name, stack, item.size());
 
 			for (auto &i : item)
 			{
@@ -52,14 +56,23 @@ namespace ent
 			if constexpr (is_not_const<T>)
 			{
 				item.clear();
+				resource::adopt(item);
+
+				merging::scope complete(false);
 
 				if (c.array_start(data, position, type))
 				{
+					if constexpr (!ordered)
+					{
+						if (const auto size = c.size_hint(data, position); size > 0) item.reserve(size);
+					}
+
 					while (c.array_item(data, position, type))
 					{
-						typename T::value_type child;
+						auto child = std::make_obj_using_allocator<typename T::value_type>(item.get_allocator());
 						position = vref<typename T::value_type>::decode(child, c, data, position, type);
-						item.insert(child);
+						// Items of an ordered set are encoded in order so each one normally belongs at the end
+						item.emplace_hint(item.end(), std::move(child));
 					}
 
 					c.array_end(data, position);
@@ -78,17 +91,17 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		void signature(string &dst) const override	{ type_signature(dst); }
+		static void type_signature(string &dst)
 		{
-			return is_circular(*this->reference, ancestor);
+			dst += '<';
+			vref<const typename T::value_type>::type_signature(dst);
+			dst += '>';
 		}
 
-		static bool is_circular(T &item, void *ancestor)
-		{
-			return std::any_of(item.begin(), item.end(), [=](auto &v) {
-				return vref<const typename T::value_type>::is_circular(v, ancestor);
-			});
-		}
+
+		void diff(const vbase &other, string &level, const reporter &report) const override	{ diff(*this->reference, *static_cast<const vref &>(other).reference, level, report); }
+		static void diff(T &before, T &after, string &level, const reporter &report)		{ diff_value(before, after, level, report); }
 
 
 		tree to_tree() const override 				{ return to_tree(*this->reference); }
@@ -115,6 +128,8 @@ namespace ent
 				typename T::value_type child;
 				item.clear();
 
+				merging::scope complete(false);
+
 				if (data.get_type() == tree::Type::Array)
 				{
 					for (auto &i : data.as_array())
@@ -47,8 +47,22 @@ namespace ent
 			return position;
 		};
 
-		bool is_circular(void *) const override				{ return false; }
-		static bool is_circular(T &, void *)				{ return false; }
+		void signature(string &dst) const override			{ type_signature(dst); }
+		static void type_signature(string &dst)
+		{
+			using V = std::remove_const_t<T>;
+
+			if constexpr (std::is_same_v<V, bool>)					dst += 'b';
+			else if constexpr (std::is_same_v<V, string>)			dst += 's';
+			else if constexpr (std::is_same_v<V, vector<uint8_t>>)	dst += 'x';
+			else
+			{
+				dst += std::is_floating_point_v<V> ? 'f' : std::is_signed_v<V> ? 'i' : 'u';
+				dst += std::to_string(sizeof(V));
+			}
+		}
+		void diff(const vbase &other, string &level, const reporter &report) const override	{ diff(*this->reference, *static_cast<const vref &>(other).reference, level, report); }
+		static void diff(T &before, T &after, string &level, const reporter &report)		{ diff_value(before, after, level, report); }
 
 		tree to_tree() const override 						{ return *this->reference; }
 		void from_tree(const tree &data) override			{ return from_tree(*this->reference, data); } //data.as(*this->reference); }
@@ -0,0 +1,86 @@
+#pragma once
+#include <entity/vref/base.hpp>
+#include <string>
+#include <string_view>
+#include <memory_resource>
+
+
+namespace ent
+{
+	// Equivalent to std::pmr::string, which is not declared by libstdc++ when using the old ABI
+	using pmr_string = std::basic_string<char, std::char_traits<char>, std::pmr::polymorphic_allocator<char>>;
+
+	template <typename T> using if_pmr_string = typename std::enable_if_t<std::is_same_v<pmr_string, std::remove_const_t<T>>>;
+
+
+	// Reference to a pmr string, which is converted to/from std::string at the codec boundary
+	// while the characters of the decoded string are allocated by its own resource
+	template <class T> struct vref<T, if_pmr_string<T>> : vbase
+	{
+		vref(T &reference) : reference(&reference) {}
+
+
+		void encode(const codec &c, os &dst, const string &name, stack<int> &stack) const override
+		{
+			encode(*this->reference, c, dst, name, stack);
+		};
+
+		int decode(const codec &c, const string &data, int position, int type) override
+		{
+			return decode(*this->reference, c, data, position, type);
+		};
+
+		static void encode(T &item, const codec &c, os &dst, const string &name, stack<int> &stack)
+		{
+			c.item(dst, name, string(item), stack.size());
+		}
+
+		static int decode(T &item, const codec &c, const string &data, int position, int type)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				resource::adopt(item);
+				item = std::string_view(c.get(data, position, type, string()));
+			}
+			else
+			{
+				c.skip(data, position, type);
+			}
+			return position;
+		};
+
+		void signature(string &dst) const override			{ type_signature(dst); }
+		static void type_signature(string &dst)				{ dst += 's'; }
+		void diff(const vbase &other, string &level, const reporter &report) const override	{ diff(*this->reference, *static_cast<const vref &>(other).reference, level, report); }
+		static void diff(T &before, T &after, string &level, const reporter &report)		{ diff_value(before, after, level, report); }
+
+		tree to_tree() const override 						{ return to_tree(*this->reference); }
+		void from_tree(const tree &data) override			{ return from_tree(*this->reference, data); }
+		static tree to_tree(T &item)						{ return string(item); }
+		static void from_tree(T &item, const tree &data)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				item = std::string_view(data.as_string());
+			}
+		}
+
+		void modify(std::function<void(any_ref)> modifier, const bool = true) override
+		{
+			if constexpr (is_not_const<T>)
+			{
+				modifier(*this->reference);
+			}
+		}
+
+		static void modify(T &item, std::function<void(any_ref)> modifier, const bool = true)
+		{
+			if constexpr (is_not_const<T>)
+			{
+				modifier(item);
+			}
+		}
+
+		T *reference;
+	};
+}
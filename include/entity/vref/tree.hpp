@@ -34,7 +34,8 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
-				item = c.item(data, position, type);
+				if (merging::active())	merge(item, c.item(data, position, type));
+				else					item = c.item(data, position, type);
 			}
 			else
 			{
@@ -44,8 +45,32 @@ namespace ent
 			return position;
 		}
 
-		bool is_circular(void *) const override				{ return false; }
-		static bool is_circular(T &, void *)				{ return false; }
+		void signature(string &dst) const override			{ type_signature(dst); }
+		static void type_signature(string &dst)				{ dst += 't'; }
+		void diff(const vbase &other, string &level, const reporter &report) const override	{ diff(*this->reference, *static_cast<const vref &>(other).reference, level, report); }
+
+		// Objects are compared property by property, skipping those that exist on only one side
+		static void diff(T &before, T &after, string &level, const reporter &report)
+		{
+			if (before.get_type() == tree::Type::Object && after.get_type() == tree::Type::Object)
+			{
+				for (auto &[name, b] : before.children)
+				{
+					auto a = after.children.find(name);
+
+					if (a != after.children.end())
+					{
+						nested n(level, name);
+						diff(b, a->second, level, report);
+					}
+				}
+			}
+			else
+			{
+				diff_value(before, after, level, report);
+			}
+		}
+
 		tree to_tree() const override						{ return *this->reference; }
 		void from_tree(const tree &data) override			{ from_tree(*this->reference, data); }
 		static tree to_tree(T &item)						{ return item; }
@@ -53,12 +78,35 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
-				item = data;
+				if (merging::active())	merge(item, data);
+				else					item = data;
 				// data.as(item);
 			}
 		}
 
 
+		// Apply a merge patch (RFC 7386) to the tree
+		static void merge(tree &target, const tree &patch)
+		{
+			if (patch.get_type() != tree::Type::Object)
+			{
+				target = patch;
+				return;
+			}
+
+			if (target.get_type() != tree::Type::Object)
+			{
+				target = tree();
+			}
+
+			for (auto &[name, value] : patch.children)
+			{
+				if (value.null())	target.children.erase(name);
+				else				merge(target.children[name], value);
+			}
+		}
+
+
 		// Traversing the tree is the responsibility of the modifier function and so
 		// the recurse option is ignored.
 		void modify(std::function<void(any_ref)> modifier, const bool = true) override
@@ -2,19 +2,24 @@
 #include <entity/vref/base.hpp>
 #include <algorithm>
 #include <vector>
+#include <deque>
 
 
 namespace ent
 {
 	template <typename T> using if_vector = typename std::enable_if_t<
-		    std::is_same_v<std::vector<typename T::value_type>, std::remove_const_t<T>>
+		(	std::is_same_v<std::vector<typename T::value_type, typename T::allocator_type>, std::remove_const_t<T>>
 		&& !std::is_same_v<typename T::value_type, uint8_t>
+		) || std::is_same_v<std::deque<typename T::value_type, typename T::allocator_type>, std::remove_const_t<T>>
 	>;
 
 
-	// Reference to std::vector (except vector<byte>)
+	// Reference to std::vector (except vector<byte>) or std::deque with any allocator, including
+	// std::pmr::vector
 	template <class T> struct vref<T, if_vector<T>> : vbase
 	{
+		static constexpr bool contiguous = std::is_same_v<std::vector<typename T::value_type, typename T::allocator_type>, std::remove_const_t<T>>;
+
 		vref(T &reference) : reference(&reference) {}
 		// vref(const T &reference) : reference(&reference) {}
 
@@ -30,7 +35,7 @@ namespace ent
 			int j = item.size() - 1;
 			int k = 0;
 
-			c.array_start(dst, name, stack);
+			c.array_start(dst, name, stack, item.size());
 
 			for (auto &i : item)
 			{
@@ -53,10 +58,22 @@ namespace ent
 			if constexpr (is_not_const<T>)
 			{
 				// item.clear();
+				resource::adopt(item);
+
+				// The items of an array in a merge patch are complete values that replace the existing ones
+				if (merging::active()) item.clear();
+
+				merging::scope complete(false);
 				const int length = item.size();
 
 				if (c.array_start(data, position, type))
 				{
+					// Allocate once where the codec knows the number of items
+					if constexpr (contiguous)
+					{
+						if (const auto size = c.size_hint(data, position); size > length) item.reserve(size);
+					}
+
 					// while (c.array_item(data, position, type))
 					for (int i=0; c.array_item(data, position, type); i++)
 					{
@@ -66,9 +83,8 @@ namespace ent
 						}
 						else
 						{
-							typename T::value_type child;
-							position = vref<typename T::value_type>::decode(child, c, data, position, type);
-							item.insert(item.end(), child);
+							// Constructed in place so that allocator-aware items use the allocator of the vector
+							position = vref<typename T::value_type>::decode(item.emplace_back(), c, data, position, type);
 						}
 					}
 
@@ -88,16 +104,44 @@ namespace ent
 		}
 
 
-		bool is_circular(void *ancestor) const override
+		void signature(string &dst) const override	{ type_signature(dst); }
+		static void type_signature(string &dst)
+		{
+			dst += '[';
+			vref<const typename T::value_type>::type_signature(dst);
+			dst += ']';
+		}
+
+
+		void diff(const vbase &other, string &level, const reporter &report) const override
 		{
-			return is_circular(*this->reference, ancestor);
+			diff(*this->reference, *static_cast<const vref &>(other).reference, level, report);
 		}
 
-		static bool is_circular(T &item, void *ancestor)
+		static void diff(T &before, T &after, string &level, const reporter &report)
 		{
-			return std::any_of(item.begin(), item.end(), [=](auto &v) {
-				return vref<const typename T::value_type>::is_circular(v, ancestor);
-			});
+			using E = const typename T::value_type;
+			const size_t common = std::min(before.size(), after.size());
+
+			for (size_t i = 0; i < common; i++)
+			{
+				nested n(level, std::to_string(i));
+				vref<E>::diff(before[i], after[i], level, report);
+			}
+
+			for (size_t i = common; i < before.size(); i++)
+			{
+				nested n(level, std::to_string(i));
+				vref<E> b(before[i]);
+				report(level, &b, nullptr);
+			}
+
+			for (size_t i = common; i < after.size(); i++)
+			{
+				nested n(level, std::to_string(i));
+				vref<E> a(after[i]);
+				report(level, nullptr, &a);
+			}
 		}
 
 
@@ -122,6 +166,9 @@ namespace ent
 		{
 			if constexpr (is_not_const<T>)
 			{
+				if (merging::active()) item.clear();
+
+				merging::scope complete(false);
 				const int length = item.size();
 				// item.clear();
 
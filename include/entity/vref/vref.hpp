@@ -1,6 +1,7 @@
 #pragma once
 
 #include <entity/vref/simple.hpp>
+#include <entity/vref/string.hpp>
 #include <entity/vref/path.hpp>
 #include <entity/vref/enum.hpp>
 #include <entity/vref/vector.hpp>
@@ -10,3 +11,4 @@
 #include <entity/vref/array.hpp>
 #include <entity/vref/entity.hpp>
 #include <entity/vref/pointer.hpp>
+#include <entity/vref/optional.hpp>
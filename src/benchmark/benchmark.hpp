@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <cstdio>
+
+
+// Minimal timing helper for the benchmarks. The function is invoked repeatedly and the mean
+// time per iteration is printed. The result of each invocation is passed to a sink so that
+// the optimiser cannot discard the work.
+template <typename F> double benchmark(const std::string &name, int iterations, F function)
+{
+	using namespace std::chrono;
+
+	volatile size_t sink = 0;
+	const auto start = steady_clock::now();
+
+	for (int i = 0; i < iterations; i++)
+	{
+		sink = sink + (size_t)function();
+	}
+
+	const double result = duration<double, std::micro>(steady_clock::now() - start).count() / iterations;
+
+	std::printf("%-40s %12.3f us\n", name.c_str(), result);
+	return result;
+}
@@ -0,0 +1,92 @@
+#include "benchmark.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/bson.hpp>
+#include <entity/cbor.hpp>
+#include <entity/msgpack.hpp>
+#include <entity/compact.hpp>
+#include <entity/query/encoded.hpp>
+
+using namespace std;
+using namespace ent;
+
+
+struct Item
+{
+	string name			= "an item name";
+	bool flag			= true;
+	int integer			= 42;
+	int64_t bignumber	= -20349758123;
+	double half			= 0.5;
+	double floating		= 3.142;
+	vector<uint8_t> binary	= vector<uint8_t>(64, 0xaa);
+	vector<int> ints		= { 1, 200, 70000, -5 };
+	map<string, string> dictionary = {{ "first", "1" }, { "second", "2" }};
+
+	emap(eref(name), eref(flag), eref(integer), eref(bignumber), eref(half), eref(floating), eref(binary), eref(ints), eref(dictionary))
+};
+
+
+struct Probe
+{
+	int integer = 0;
+
+	emap(eref(integer))
+};
+
+
+struct Collection
+{
+	vector<Item> items = vector<Item>(1000);
+
+	emap(eref(items))
+};
+
+
+template <class Codec> void compare(const string &name, const Collection &collection)
+{
+	const auto data = encode<Codec>(collection);
+
+	printf("\n%s: %zu bytes\n", name.c_str(), data.size());
+
+	benchmark(name + " encode",		100, [&] { return encode<Codec>(collection).size(); });
+	benchmark(name + " decode",		100, [&] { return decode<Codec, Collection>(data).items.size(); });
+	benchmark(name + " decode tree",	100, [&] { return decode<Codec>(data).children.size(); });
+	benchmark(name + " decode projection",	100, [&] { return decode_fields<Codec, Collection>(data, projection { "items.integer" }).items.size(); });
+}
+
+
+// Filtering the items directly from the encoded data
+template <class Codec> void filter(const string &name, const Collection &collection)
+{
+	const auto data		= encode<Codec>(collection);
+	auto predicate		= [](auto &i) { return i.integer != 42; };
+
+	printf("\n%s: %zu bytes\n", name.c_str(), data.size());
+
+	benchmark(name + " decode, query",		100, [&] {
+		auto decoded = decode<Codec, Collection>(data);
+		return from(decoded.items).where(predicate).count();
+	});
+	benchmark(name + " encoded query",		100, [&] { return from<Codec, Item>(data, "items").where(predicate).count(); });
+	benchmark(name + " encoded query probe",	100, [&] { return from<Codec, Item, Probe>(data, predicate, "items").count(); });
+}
+
+
+int main()
+{
+	Collection collection;
+
+	compare<json>("json", collection);
+	compare<bson>("bson", collection);
+	compare<msgpack>("msgpack", collection);
+	compare<cbor>("cbor", collection);
+	compare<compact>("compact", collection);
+
+	filter<json>("json", collection);
+	filter<bson>("bson", collection);
+	filter<msgpack>("msgpack", collection);
+	filter<cbor>("cbor", collection);
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "benchmark.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/msgpack.hpp>
+#include <entity/compact.hpp>
+#include <set>
+#include <map>
+
+using namespace std;
+using namespace ent;
+
+
+template <class Codec, class T> void run(const string &name, const T &container)
+{
+	const auto data = encode<Codec>(container);
+
+	benchmark(name + " decode",			10, [&] { return decode<Codec, T>(data).size(); });
+	benchmark(name + " decode into",	10, [&] {
+		T result = container;
+		return decode<Codec>(data, result).size();
+	});
+}
+
+
+template <class Codec> void run(const string &name, const vector<int> &values, const set<int> &unique, const map<string, int> &lookup)
+{
+	run<Codec>(name + " vector", values);
+	run<Codec>(name + " set", unique);
+	run<Codec>(name + " map", lookup);
+
+	const auto data = encode<Codec>(tree(vector<tree>(values.begin(), values.end())));
+
+	benchmark(name + " tree array decode", 10, [&] { return decode<Codec>(data).as_array().size(); });
+}
+
+
+int main()
+{
+	// 1M items in each container
+	const int size = 1000000;
+	vector<int> values;
+	set<int> unique;
+	map<string, int> lookup;
+
+	for (int i = 0; i < size; i++)
+	{
+		values.push_back(i);
+		unique.insert(i);
+		lookup[std::to_string(i)] = i;
+	}
+
+	run<msgpack>("msgpack", values, unique, lookup);
+	run<compact>("compact", values, unique, lookup);
+	run<json>("json", values, unique, lookup);
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "benchmark.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/tracked.hpp>
+#include <memory>
+#include <memory_resource>
+
+using namespace std;
+using namespace ent;
+
+
+// A node in a chain of shared pointers
+struct Node
+{
+	int value = 0;
+	shared_ptr<Node> next;
+
+	emap(eref(value), eref(next))
+};
+
+
+struct Graph
+{
+	vector<shared_ptr<Node>> chains;
+
+	emap(eref(chains))
+};
+
+
+int main()
+{
+	// 100k nodes split into chains, which keeps the recursion depth of the encoder reasonable
+	const int chains	= 100;
+	const int length	= 1000;
+	Graph graph;
+
+	for (int i = 0; i < chains; i++)
+	{
+		shared_ptr<Node> head;
+
+		for (int j = 0; j < length; j++)
+		{
+			auto node	= make_shared<Node>();
+			node->value	= j;
+			node->next	= head;
+			head		= node;
+		}
+
+		graph.chains.push_back(head);
+	}
+
+	const auto data = encode<json>(graph);
+
+	benchmark("encode linked nodes", 10, [&] { return encode<json>(graph).size(); });
+	benchmark("decode linked nodes", 10, [&] { return decode<json, Graph>(data).chains.size(); });
+	benchmark("decode linked nodes arena", 10, [&] {
+		std::pmr::monotonic_buffer_resource arena;
+		Graph result;
+		return decode<json>(data, result, &arena).chains.size();
+	});
+	benchmark("decode into linked nodes", 10, [&] { return decode<json>(data, graph).chains.size(); });
+	benchmark("to_tree linked nodes", 10, [&] { return to_tree(graph).children.size(); });
+
+	// 100k references to the chains, each shortened to 10 nodes
+	Graph shared;
+
+	for (auto &c : graph.chains)
+	{
+		auto node = c;
+		for (int j = 1; j < 10; j++) node = node->next;
+		node->next = nullptr;
+	}
+
+	for (int i = 0; i < 100000; i++)
+	{
+		shared.chains.push_back(graph.chains[i % chains]);
+	}
+
+	const auto plain	= encode<json>(shared);
+	const auto tracked	= encode<ent::tracked<json>>(shared);
+
+	printf("\nshared nodes: %zu bytes, tracked: %zu bytes\n", plain.size(), tracked.size());
+
+	benchmark("encode shared nodes", 10, [&] { return encode<json>(shared).size(); });
+	benchmark("encode shared nodes tracked", 10, [&] { return encode<ent::tracked<json>>(shared).size(); });
+	benchmark("decode shared nodes", 10, [&] { return decode<json, Graph>(plain).chains.size(); });
+	benchmark("decode shared nodes tracked", 10, [&] { return decode<ent::tracked<json>, Graph>(tracked).chains.size(); });
+
+	return 0;
+}
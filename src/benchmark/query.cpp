@@ -0,0 +1,155 @@
+#include "benchmark.hpp"
+#include <entity/query.hpp>
+#include <string>
+
+using namespace std;
+using namespace ent;
+
+
+struct Item
+{
+	string name;
+	int number;
+	double value;
+};
+
+
+int main()
+{
+	const int size = 10000000;
+	vector<Item> items(size);
+
+	for (int i = 0; i < size; i++)
+	{
+		items[i] = { "item", i, i * 0.5 };
+	}
+
+	benchmark("hand loop", 10, [&] {
+		double result = 0;
+
+		for (auto &i : items)
+		{
+			if (i.number % 3 == 0) result += i.value;
+		}
+
+		return result;
+	});
+
+	benchmark("hand loop field sum", 10, [&] {
+		double result = 0;
+
+		for (auto &i : items) result += i.value;
+
+		return result;
+	});
+
+	vector<double> values(size, 0.5);
+
+	benchmark("hand loop values sum", 10, [&] {
+		double result = 0;
+
+		for (auto &v : values) result += v;
+
+		return result;
+	});
+
+	benchmark("values sum", 10, [&] {
+		return from(values).sum();
+	});
+
+	benchmark("select, sum", 10, [&] {
+		return from(items).select([](auto &i) { return i.value; }).sum();
+	});
+
+	benchmark("select, stable_sum", 10, [&] {
+		return from(items).select([](auto &i) { return i.value; }).stable_sum();
+	});
+
+	benchmark("where, select, sum", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<double>([](auto &i) { return i.value; })
+			.sum();
+	});
+
+	benchmark("parallel where, select, sum", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<double>([](auto &i) { return i.value; })
+			.parallel()
+			.sum();
+	});
+
+	benchmark("batch where, select, sum", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<double>([](auto &i) { return i.value; })
+			.batch()
+			.sum();
+	});
+
+	benchmark("where, where, select, count", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.where([](auto &i) { return i.value < 4000000; })
+			.select<int>([](auto &i) { return i.number; })
+			.count([](auto &i) { return i % 2 == 0; });
+	});
+
+	benchmark("batch where, where, select, count", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.where([](auto &i) { return i.value < 4000000; })
+			.select<int>([](auto &i) { return i.number; })
+			.batch()
+			.count([](auto &i) { return i % 2 == 0; });
+	});
+
+	benchmark("where, select, skip, take, count", 10, [&] {
+		return from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<int>([](auto &i) { return i.number; })
+			.skip(10)
+			.take(size / 2)
+			.count();
+	});
+
+	benchmark("select, distinct, count", 10, [&] {
+		return from(items)
+			.select([](auto &i) { return i.number % 100000; })
+			.distinct()
+			.count();
+	});
+
+	benchmark("order_by, take", 10, [&] {
+		return from(items)
+			.order_by([](auto &i) { return i.value; }, true)
+			.take(10)
+			.first().number;
+	});
+
+	benchmark("order_by, then_by, first", 2, [&] {
+		return from(items)
+			.order_by([](auto &i) { return i.number % 1000; })
+			.then_by([](auto &i) { return i.value; }, true)
+			.first().number;
+	});
+
+	benchmark("type-erased where, select, sum", 10, [&] {
+		query<double> q = from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<double>([](auto &i) { return i.value; });
+
+		return q.sum();
+	});
+
+	benchmark("type-erased batch where, select, sum", 10, [&] {
+		query<double> q = from(items)
+			.where([](auto &i) { return i.number % 3 == 0; })
+			.select<double>([](auto &i) { return i.value; });
+
+		return q.batch().sum();
+	});
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+// Fuzz target for the BSON decoder, exercising decode<bson> to both entities and trees.
+//
+// With libFuzzer (clang) configure with -DENTITY_FUZZ=ON and run:
+//   ./fuzz-bson -max_len=4096 corpus/
+//
+// For AFL or for replaying crashing inputs compile with ENT_FUZZ_STANDALONE defined so that
+// a main is provided which reads a single input from stdin:
+//   afl-clang-fast++ -std=c++20 -DENT_FUZZ_STANDALONE -Iinclude src/fuzz/bson.cpp -o fuzz-bson
+#include <entity/entity.hpp>
+#include <entity/bson.hpp>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+using namespace ent;
+
+
+struct Child
+{
+	string name;
+	double value = 0;
+	vector<uint8_t> blob;
+
+	emap(eref(name), eref(value), eref(blob))
+};
+
+
+struct Fuzz
+{
+	bool flag		= false;
+	int integer		= 0;
+	int64_t big		= 0;
+	string text;
+	vector<int> ints;
+	set<string> strings;
+	map<string, Child> children;
+	array<Child, 2> fixed;
+	shared_ptr<Child> pointer;
+	tree dynamic;
+
+	emap(eref(flag), eref(integer), eref(big), eref(text), eref(ints), eref(strings), eref(children), eref(fixed), eref(pointer), eref(dynamic))
+};
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	const string input((const char *)data, size);
+
+	// Each decode is attempted both with and without validation since the latter relies
+	// solely on the checked increments within the decoder. Exceptions are the expected
+	// outcome for invalid input, anything else (a crash or sanitizer report) is a bug.
+	for (bool skipValidation : { false, true })
+	{
+		try { decode<bson>(input, skipValidation); }			catch (const std::runtime_error &) {}
+		try { decode<bson, Fuzz>(input, skipValidation); }		catch (const std::runtime_error &) {}
+	}
+
+	return 0;
+}
+
+
+#ifdef ENT_FUZZ_STANDALONE
+int main()
+{
+	const string input(std::istreambuf_iterator<char>(std::cin), {});
+
+	return LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+}
+#endif
@@ -107,8 +107,8 @@ TEST_SUITE("bson")
 		vector<string> invalid_vectors = {
 			convert({ 0x00,0x00 }),																									// Document too short
 			convert({ 0x0f,0x00,0x00,0x00,0x00 }),																					// Invalid document length
-			//convert({ 0x0d,0x00,0x00,0x00,0x00,0x10,0x61,0x00,0x2a,0x00,0x00,0x00,0x00 }), 										// Unexpected exit
-			//convert({ 0x15,0x00,0x00,0x00,0x04,0x61,0x00,0x0d,0x00,0x00,0x00,0x00,0x10,0x31,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),// Unexpected array exit
+			convert({ 0x0d,0x00,0x00,0x00,0x00,0x10,0x61,0x00,0x2a,0x00,0x00,0x00,0x00 }), 										// Unexpected exit
+			convert({ 0x15,0x00,0x00,0x00,0x04,0x61,0x00,0x0d,0x00,0x00,0x00,0x00,0x10,0x31,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),	// Unexpected array exit
 			convert({ 0x14,0x00,0x00,0x00,0x04,0x61,0x00,0x0f,0x00,0x00,0x00,0x10,0x30,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),		// Invalid array document length
 
 			convert({ 0x0a,0x00,0x00,0x00,0x10,0x61,0x00,0x2a,0x00,0x00 }),							// Insufficient data to read int32
@@ -124,5 +124,129 @@ TEST_SUITE("bson")
 			CHECK_THROWS(decode<bson>(i));
 		}
 	}
+
+
+	TEST_CASE("validation checks every nested length and terminator")
+	{
+		vector<string> invalid_vectors = {
+			convert({ 0x14,0x00,0x00,0x00,0x03,0x61,0x00,0x0d,0x00,0x00,0x00,0x10,0x62,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),	// Nested document overruns its parent
+			convert({ 0x14,0x00,0x00,0x00,0x03,0x61,0x00,0xfc,0xff,0xff,0xff,0x10,0x62,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),	// Negative nested document length
+			convert({ 0x0e,0x00,0x00,0x00,0x02,0x61,0x00,0xff,0xff,0xff,0x7f,0x62,0x00,0x00 }),								// Huge string length
+			convert({ 0x0e,0x00,0x00,0x00,0x02,0x61,0x00,0x02,0x00,0x00,0x00,0x62,0x63,0x00 }),								// Unterminated string
+			convert({ 0x0f,0x00,0x00,0x00,0x05,0x61,0x00,0xfe,0xff,0xff,0xff,0x00,0x00,0xff,0x00 }),						// Negative binary length
+			convert({ 0x0c,0x00,0x00,0x00,0x10,0x61,0x62,0x63,0x64,0x65,0x66,0x00 }),										// Name runs into the terminator
+			convert({ 0x08,0x00,0x00,0x00,0x20,0x61,0x00,0x00 }),															// Unknown element type
+		};
+
+		for (auto &i : invalid_vectors)
+		{
+			CHECK_THROWS(bson().validate(i));
+		}
+
+		CHECK(bson().validate(encode<bson>({{ "a", {{ "b", vector<tree> { 1, "two", vector<uint8_t> { 3 } } }} }})));
+	}
+
+
+	TEST_CASE("excessive nesting is rejected with or without validation")
+	{
+		// Each level is a document holding a single embedded document named "a"
+		auto nested = [](int depth) {
+			string result;
+
+			for (int i = depth; i > 0; i--)
+			{
+				const int32_t length = 5 + 8 * i;
+				result.append((char *)&length, 4).append({ 0x03, 0x61, 0x00 });
+			}
+
+			return result.append({ 0x05, 0x00, 0x00, 0x00, 0x00 }).append(depth, 0x00);
+		};
+
+		CHECK_THROWS(bson().validate(nested(1000)));
+		CHECK_THROWS(decode<bson>(nested(1000)));
+		CHECK_THROWS(decode<bson>(nested(200000), true));
+
+		// Nesting within the limit is accepted
+		CHECK(decode<bson>(nested(100)).get_type() == tree::Type::Object);
+		CHECK(decode<bson>(nested(100), true).get_type() == tree::Type::Object);
+	}
+
+
+	TEST_CASE("decoding without validation never reads beyond the buffer")
+	{
+		vector<string> invalid_vectors = {
+			convert({ 0x14,0x00,0x00,0x00,0x03,0x61,0x00,0xfc,0xff,0xff,0xff,0x10,0x62,0x00,0x2a,0x00,0x00,0x00,0x00,0x00 }),	// Negative nested document length
+			convert({ 0x0e,0x00,0x00,0x00,0x02,0x61,0x00,0xff,0xff,0xff,0x7f,0x62,0x00,0x00 }),								// Huge string length
+			convert({ 0x0e,0x00,0x00,0x00,0x02,0x61,0x00,0x00,0x00,0x00,0x00,0x62,0x00,0x00 }),								// Zero string length
+			convert({ 0x0f,0x00,0x00,0x00,0x05,0x61,0x00,0xfe,0xff,0xff,0xff,0x00,0x00,0xff,0x00 }),						// Negative binary length
+			convert({ 0x0f,0x00,0x00,0x00,0x07,0x61,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 }),						// Truncated unsupported type
+		};
+
+		for (auto &i : invalid_vectors)
+		{
+			CHECK_THROWS(decode<bson>(i, true));
+		}
+
+		struct Entity
+		{
+			int b = 0;
+			emap(eref(b))
+		};
+
+		// Lengths at the limits of a 32-bit integer that must not overflow when adjusted
+		vector<string> extreme_vectors = {
+			convert({ 0x0f,0x00,0x00,0x00,0x05,0x61,0x00,0xff,0xff,0xff,0x7f,0x00,0x00,0x00,0x00 }),	// Maximum binary length
+			convert({ 0x0f,0x00,0x00,0x00,0x03,0x61,0x00,0x00,0x00,0x00,0x80,0x00,0x00,0x00,0x00 }),	// Minimum nested document length
+			convert({ 0x0f,0x00,0x00,0x00,0x0f,0x61,0x00,0x00,0x00,0x00,0x80,0x00,0x00,0x00,0x00 }),	// Minimum code with scope length
+		};
+
+		for (auto &i : extreme_vectors)
+		{
+			CHECK_THROWS(decode<bson, Entity>(i, true));
+		}
+
+		CHECK_THROWS(decode<bson>(extreme_vectors[2], true));
+	}
+
+
+	TEST_CASE("unknown fields are skipped when decoding an entity")
+	{
+		struct Entity
+		{
+			int b = 0;
+			emap(eref(b))
+		};
+
+		const auto data = encode<bson>({
+			{ "a", "skipped" },
+			{ "aa", vector<uint8_t> { 1, 2, 3 } },
+			{ "ab", {{ "c", 1 }} },
+			{ "b", 42 }
+		});
+
+		CHECK(decode<bson, Entity>(data).b == 42);
+	}
+
+
+	TEST_CASE("fields equal to their defaults can be omitted")
+	{
+		struct Entity
+		{
+			int a = 0;
+			string b;
+			vector<int> c;
+			double d = 0;
+			emap(eref(a), eref(b), eref(c), eref(d))
+		};
+
+		Entity e;
+		e.d = 1.5;
+
+		const auto data = encode<bson>(e, { .omit_defaults = true });
+
+		CHECK(data				== encode<bson>(tree {{ "d", 1.5 }}));
+		CHECK(data.size()		< encode<bson>(e).size());
+		CHECK(decode<bson, Entity>(data).d == 1.5);
+	}
 }
 
@@ -0,0 +1,151 @@
+#include "doctest.h"
+#include "fixtures.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/cbor.hpp>
+
+using namespace std;
+using namespace ent;
+using namespace fixtures;
+
+
+TEST_SUITE("cbor")
+{
+	TEST_CASE("simple types can be converted to/from cbor")
+	{
+		// Values taken from RFC 8949 appendix A
+		map<string, tree> test_vectors = {
+					// |Map |  Key    |  Value                                                 |End |
+			{ bytes({ 0xbf,0x61,0x61,0x17,0xff }),										tree {{ "a", 23 }} },							// Unsigned
+			{ bytes({ 0xbf,0x61,0x61,0x18,0x18,0xff }),								tree {{ "a", 24 }} },							// Unsigned 8-bit
+			{ bytes({ 0xbf,0x61,0x61,0x1a,0x00,0x0f,0x42,0x40,0xff }),					tree {{ "a", 1000000 }} },						// Unsigned 32-bit
+			{ bytes({ 0xbf,0x61,0x61,0x1b,0x00,0x00,0x00,0xe8,0xd4,0xa5,0x10,0x00,0xff }),	tree {{ "a", 1000000000000 }} },			// Unsigned 64-bit
+			{ bytes({ 0xbf,0x61,0x61,0x20,0xff }),										tree {{ "a", -1 }} },							// Negative
+			{ bytes({ 0xbf,0x61,0x61,0x39,0x03,0xe7,0xff }),							tree {{ "a", -1000 }} },						// Negative 16-bit
+			{ bytes({ 0xbf,0x61,0x61,0xf9,0x3e,0x00,0xff }),							tree {{ "a", 1.5 }} },							// Half
+			{ bytes({ 0xbf,0x61,0x61,0xf9,0x00,0x01,0xff }),							tree {{ "a", 5.960464477539063e-8 }} },			// Half subnormal
+			{ bytes({ 0xbf,0x61,0x61,0xf9,0x7b,0xff,0xff }),							tree {{ "a", 65504.0 }} },						// Half maximum
+			{ bytes({ 0xbf,0x61,0x61,0xfa,0x47,0xc3,0x50,0x00,0xff }),					tree {{ "a", 100000.0 }} },						// Single
+			{ bytes({ 0xbf,0x61,0x61,0xfb,0x3f,0xf1,0x99,0x99,0x99,0x99,0x99,0x9a,0xff }),	tree {{ "a", 1.1 }} },						// Double
+			{ bytes({ 0xbf,0x61,0x61,0x64,0x49,0x45,0x54,0x46,0xff }),					tree {{ "a", "IETF" }} },						// Text
+			{ bytes({ 0xbf,0x61,0x61,0xf5,0xff }),										tree {{ "a", true }} },							// Boolean
+			{ bytes({ 0xbf,0x61,0x61,0xf6,0xff }),										tree {{ "a", nullptr }} },						// Null
+			{ bytes({ 0xbf,0x61,0x61,0x42,0x00,0xff,0xff }),							tree {{ "a", vector<uint8_t> { 0x00, 0xff } }} },// Bytes
+			{ bytes({ 0xbf,0x61,0x61,0x9f,0x01,0x02,0xff,0xff }),						tree {{ "a", vector<tree> { 1, 2 } }} },		// Array
+			{ bytes({ 0xbf,0x61,0x61,0xbf,0x61,0x62,0x01,0xff,0xff }),					tree {{ "a", {{ "b", 1 }} }} },					// Map
+		};
+
+
+		SUBCASE("simple types can be serialised")
+		{
+			for (auto &i : test_vectors)
+			{
+				CHECK( encode<cbor>(i.second) == i.first );
+			}
+		}
+
+
+		SUBCASE("simple types can be deserialised")
+		{
+			for (auto &i : test_vectors)
+			{
+				CHECK( (decode<cbor>(i.first)["a"] == i.second["a"]) );
+			}
+		}
+	}
+
+
+	TEST_CASE("definite lengths, chunked strings and tags can be decoded")
+	{
+		// {"a": [1, [2, 3]], "b": "streaming", "c": h'0102030405', "d": 1(1363896240)}
+		const auto data = bytes({
+			0xa4,
+				0x61,0x61,	0x82,0x01,0x82,0x02,0x03,
+				0x61,0x62,	0x7f,0x65,0x73,0x74,0x72,0x65,0x61,0x64,0x6d,0x69,0x6e,0x67,0xff,
+				0x61,0x63,	0x5f,0x42,0x01,0x02,0x43,0x03,0x04,0x05,0xff,
+				0x61,0x64,	0xc1,0x1a,0x51,0x4b,0x67,0xb0
+		});
+
+		auto t = decode<cbor>(data);
+
+		CHECK(t["a"].as_array().size()				== 2);
+		CHECK(t["a"].as_array()[1].as_array()[1]	== 3);
+		CHECK(t["b"].as_string()					== "streaming");
+		CHECK(t["c"].as_binary()					== vector<uint8_t> { 1, 2, 3, 4, 5 });
+		CHECK(t["d"].as_long()						== 1363896240);
+	}
+
+
+	TEST_CASE("an entity can be converted to/from cbor")
+	{
+		Simple e;
+		e.dictionary = {{ "a", "1" }, { "b", "2" }};
+
+		auto result = decode<cbor, Simple>(encode<cbor>(e));
+
+		CHECK(result.name		== e.name);
+		CHECK(result.flag		== e.flag);
+		CHECK(result.integer	== e.integer);
+		CHECK(result.bignumber	== e.bignumber);
+		CHECK(result.floating	== e.floating);
+		CHECK(result.binary		== e.binary);
+		CHECK(result.ints		== e.ints);
+		CHECK(result.dictionary	== e.dictionary);
+	}
+
+
+	TEST_CASE("a vector of entities can be converted to/from cbor")
+	{
+		vector<Simple> e(3);
+		e[1].name = "second";
+
+		auto result = decode<cbor, vector<Simple>>(encode<cbor>(e));
+
+		CHECK(result.size()		== 3);
+		CHECK(result[1].name	== "second");
+	}
+
+
+	TEST_CASE("unknown fields are skipped when decoding an entity")
+	{
+		const auto data = encode<cbor>(tree {
+			{ "a", {{ "nested", vector<tree> { 1, "two", 3.5 } }} },
+			{ "integer", 8 },
+			{ "unknown", vector<uint8_t> { 1, 2, 3 } }
+		});
+
+		CHECK(decode<cbor, Simple>(data).integer == 8);
+	}
+
+
+	TEST_CASE("an entity can be encoded more compactly than JSON")
+	{
+		CHECK(encode<cbor>(Simple()).size() < encode<json>(Simple()).size());
+	}
+
+
+	TEST_CASE("parser will throw exception if the cbor is invalid")
+	{
+		vector<string> invalid_vectors = {
+			bytes({ 0xbf,0x61 }),									// Truncated key
+			bytes({ 0xbf,0x61,0x61,0x01 }),						// Missing break
+			bytes({ 0xa2,0x61,0x61,0x01 }),						// Missing map element
+			bytes({ 0xbf,0x61,0x61,0x19,0x01,0xff }),				// Truncated argument
+			bytes({ 0xbf,0x61,0x61,0x1c,0xff }),					// Reserved argument
+			bytes({ 0xbf,0x61,0x61,0x7b,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff }),	// Huge text length
+			bytes({ 0xbf,0x61,0x61,0x5f,0x61,0x62,0xff,0xff }),	// Text chunk within a byte string
+			string(100000, '\x81') + '\xf6',						// Excessive nesting
+			string(100000, '\x9f') + string(100000, '\xff'),		// Excessive indefinite nesting
+		};
+
+		for (auto &i : invalid_vectors)
+		{
+			CHECK_THROWS(decode<cbor>(i));
+			CHECK_THROWS(decode<cbor, Simple>(i));
+			CHECK_THROWS(decode<cbor>(i, true));
+		}
+
+		// Nesting within the limit is accepted
+		CHECK(decode<cbor>(string(100, '\x81') + '\xf6').get_type() == tree::Type::Array);
+	}
+}
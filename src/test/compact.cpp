@@ -0,0 +1,195 @@
+#include "doctest.h"
+#include "fixtures.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/compact.hpp>
+#include <optional>
+
+using namespace std;
+using namespace ent;
+using namespace fixtures;
+
+
+TEST_SUITE("compact")
+{
+	struct Nested
+	{
+		string name;
+		Simple simple;
+		vector<Simple> collection;
+
+		emap(eref(name), eref(simple), eref(collection))
+	};
+
+	struct Extended : Simple
+	{
+		string extra = "extra";
+
+		emerge(Simple, eref(extra))
+	};
+
+	template <class V> struct Single
+	{
+		V value = {};
+
+		emap(eref(value))
+	};
+
+	enum class Level { Low, High };
+
+	struct Recursive
+	{
+		int value = 0;
+		vector<Recursive> children;
+		std::shared_ptr<Recursive> parent;
+
+		emap(eref(value), eref(children), eref(parent))
+	};
+
+
+	TEST_CASE("integers are written as zigzag varints")
+	{
+		CHECK(encode<compact>(tree {{ "a", 0 }})		== string("\x09\x01\x01" "a" "\x03\x00", 6));
+		CHECK(encode<compact>(tree {{ "a", -1 }})		== string("\x09\x01\x01" "a" "\x03\x01", 6));
+		CHECK(encode<compact>(tree {{ "a", 1 }})		== string("\x09\x01\x01" "a" "\x03\x02", 6));
+		CHECK(encode<compact>(tree {{ "a", 300 }})		== string("\x09\x01\x01" "a" "\x03\xd8\x04", 7));
+	}
+
+
+	TEST_CASE("entities are written without field names")
+	{
+		Simple e;
+		const auto data = encode<compact>(e);
+
+		CHECK(data[0] == compact::Array);
+		CHECK(data.find("bignumber") == string::npos);
+		CHECK(data.find("simple") != string::npos);
+		CHECK(data.size() < encode<json>(e).size() / 2);
+	}
+
+
+	TEST_CASE("an entity can be converted to/from compact")
+	{
+		Nested e;
+		e.name						= "nested";
+		e.simple.dictionary			= {{ "a", "1" }, { "b", "2" }};
+		e.simple.integer			= -7;
+		e.collection				= vector<Simple>(3);
+		e.collection[1].floating	= 1.5;
+
+		auto result = decode<compact, Nested>(encode<compact>(e));
+
+		CHECK(result.name					== "nested");
+		CHECK(result.simple.name			== e.simple.name);
+		CHECK(result.simple.flag			== e.simple.flag);
+		CHECK(result.simple.integer			== -7);
+		CHECK(result.simple.bignumber		== e.simple.bignumber);
+		CHECK(result.simple.floating		== e.simple.floating);
+		CHECK(result.simple.binary			== e.simple.binary);
+		CHECK(result.simple.ints			== e.simple.ints);
+		CHECK(result.simple.dictionary		== e.simple.dictionary);
+		CHECK(result.collection.size()		== 3);
+		CHECK(result.collection[1].floating	== 1.5);
+	}
+
+
+	TEST_CASE("a projection decodes only the selected fields")
+	{
+		Nested e;
+		e.name				= "nested";
+		e.simple.integer	= -7;
+		e.simple.name		= "inner";
+		e.collection		= vector<Simple>(2);
+
+		auto result = decode_fields<compact, Nested>(encode<compact>(e), { "simple.integer", "collection.name" });
+
+		CHECK(result.name				== "");
+		CHECK(result.simple.integer		== -7);
+		CHECK(result.simple.name		== "simple");
+		CHECK(result.collection.size()	== 2);
+	}
+
+
+	TEST_CASE("data can be decoded to a tree")
+	{
+		auto t = decode<compact>(encode<compact>(Simple()));
+
+		REQUIRE(t.get_type() == tree::Type::Array);
+		CHECK(t.as_array().size() == 8);
+	}
+
+
+	TEST_CASE("additional trailing items are skipped")
+	{
+		// Fields in mapping order followed by an unknown item
+		const auto data = encode<compact>(vector<tree> {
+			5, vector<uint8_t> { 1 }, tree {{ "x", "1" }}, false, 1.5, 8, vector<tree> { 1, 2 }, "name", "trailing"
+		});
+
+		auto result = decode<compact, Simple>(data);
+
+		CHECK(result.bignumber	== 5);
+		CHECK(result.dictionary	== map<string, string> {{ "x", "1" }});
+		CHECK(result.integer	== 8);
+		CHECK(result.ints[1]	== 2);
+		CHECK(result.name		== "name");
+	}
+
+
+	TEST_CASE("the schema fingerprint detects mismatched entities")
+	{
+		CHECK(compact::fingerprint<Simple>() == compact::fingerprint<Simple>());
+		CHECK(compact::fingerprint<Simple>() != compact::fingerprint<Extended>());
+		CHECK(compact::fingerprint<Simple>() != compact::fingerprint<Nested>());
+
+		// Types are distinguished even where the default values are identical or empty
+		CHECK(compact::fingerprint<Single<int32_t>>()			!= compact::fingerprint<Single<int64_t>>());
+		CHECK(compact::fingerprint<Single<int>>()				!= compact::fingerprint<Single<Level>>());
+		CHECK(compact::fingerprint<Single<vector<int>>>()		!= compact::fingerprint<Single<vector<string>>>());
+		CHECK(compact::fingerprint<Single<vector<Simple>>>()	!= compact::fingerprint<Single<vector<Extended>>>());
+		CHECK(compact::fingerprint<Single<map<string, int>>>()	!= compact::fingerprint<Single<map<string, double>>>());
+		CHECK(compact::fingerprint<Single<optional<float>>>()	!= compact::fingerprint<Single<optional<double>>>());
+		CHECK(compact::fingerprint<Recursive>()					== compact::fingerprint<Recursive>());
+
+		Simple e;
+		e.name = "fingerprinted";
+
+		const auto data = compact::encode(e);
+
+		CHECK(compact::decode<Simple>(data).name == "fingerprinted");
+		CHECK_THROWS(compact::decode<Extended>(data));
+		CHECK_THROWS(compact::decode<Simple>(encode<compact>(e)));
+	}
+
+
+	TEST_CASE("parser will throw exception if the data is invalid")
+	{
+		// Arrays holding a single array, down to a null
+		auto nested = [](int depth) {
+			string result;
+
+			for (int i = 0; i < depth; i++) result.append("\x08\x01", 2);
+
+			return result.append(1, '\x00');
+		};
+
+		vector<string> invalid_vectors = {
+			string("\x08\x02\x03", 3),								// Missing array element
+			string("\x08\x01\x06\x05" "ab", 6),						// Truncated string
+			string("\x08\x01\x03\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 14),	// Overlong varint
+			string("\x08\x01\x0e", 3),								// Unknown type
+			nested(100000),											// Excessive nesting
+		};
+
+		for (auto &i : invalid_vectors)
+		{
+			CHECK_THROWS(decode<compact>(i));
+			CHECK_THROWS(decode<compact, Simple>(i));
+		}
+
+		CHECK_THROWS(decode<compact>(nested(100000), true));
+
+		// Nesting within the limit is accepted
+		CHECK(decode<compact>(nested(100)).get_type() == tree::Type::Array);
+	}
+}
@@ -1,6 +1,10 @@
 #include "doctest.h"
 #include <entity/entity.hpp>
 #include <entity/json.hpp>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
 
 using namespace std;
 using namespace ent;
@@ -310,6 +314,204 @@ TEST_SUITE("entity")
 	}
 
 
+	TEST_CASE("an entity can be decoded from fields in any order")
+	{
+		auto e = decode<json, SimpleEntity>(R"json({
+			"name": "unordered", "unused": 1, "integer": 7, "bignumber": 8, "flag": false, "zzz": 2, "floating": 1.5
+		})json");
+
+		CHECK(e.name		== "unordered");
+		CHECK(e.flag		== false);
+		CHECK(e.integer		== 7);
+		CHECK(e.bignumber	== 8);
+		CHECK(e.floating	== 1.5);
+
+		auto t = from_tree<SimpleEntity>(tree { { "aaa", 1 }, { "integer", 9 }, { "name", "tree" }, { "zzz", 2 } });
+
+		CHECK(t.name		== "tree");
+		CHECK(t.integer		== 9);
+		CHECK(t.flag		== true);
+	}
+
+
+	TEST_CASE("a projection decodes only the selected fields")
+	{
+		ComplexEntity e;
+		e.name					= "complex";
+		e.simple.name			= "inner";
+		e.simple.integer		= 7;
+		e.entities				= vector<SimpleEntity>(2);
+		e.entities[1].name		= "second";
+		e.entities[1].integer	= 9;
+		e.collection.strings	= { "a", "b" };
+
+		const auto data	= encode<json>(e);
+		auto result		= decode_fields<json, ComplexEntity>(data, { "name", "simple.integer", "entities.name", "collection" });
+
+		CHECK(result.name						== "complex");
+		CHECK(result.simple.integer				== 7);
+		CHECK(result.simple.name				== "simple");
+		CHECK(result.entities.size()			== 2);
+		CHECK(result.entities[1].name			== "second");
+		CHECK(result.entities[1].integer		== 42);
+		CHECK(result.collection.strings.size()	== 2);
+
+		CHECK(decode_fields<json, ComplexEntity>(data, { "simple", "simple.integer" }).simple.name	== "inner");
+		CHECK(decode_fields<json, ComplexEntity>(data, { "name" }).simple.name				== "simple");
+		CHECK(decode<json, ComplexEntity>(data).simple.name									== "inner");
+	}
+
+
+	TEST_CASE("an entity can be encoded with a field mask and without defaults")
+	{
+		ComplexEntity e;
+		e.name			= "complex";
+		e.simple.name	= "inner";
+
+		CHECK(encode<json>(e, { .fields = { "name", "simple.name" } })	== R"json({"name":"complex","simple":{"name":"inner"}})json");
+		CHECK(encode<json>(e, { .fields = { "collection" }, .omit_defaults = true })		== R"json({})json");
+		CHECK(encode<json>(e, { .omit_defaults = true })		== R"json({"name":"complex","simple":{"name":"inner"}})json");
+		CHECK(encode<json>(SimpleEntity(), { .omit_defaults = true })	== R"json({})json");
+
+		SimpleEntity s;
+		s.name		= "modified";
+		s.integer	= 7;
+
+		CHECK(encode<json>(s, { .omit_defaults = true })		== R"json({"integer":7,"name":"modified"})json");
+		CHECK(encode<prettyjson>(s, { .omit_defaults = true })	== "{\n  \"integer\": 7,\n  \"name\": \"modified\"\n}");
+	}
+
+
+	TEST_CASE("fields are only omitted when equal to the value declared by the entity")
+	{
+		// Zero values differ from the member initialisers so they must still be written
+		SimpleEntity s;
+		s.name		= "";
+		s.integer	= 0;
+		s.flag		= false;
+
+		const auto data = encode<json>(s, { .omit_defaults = true });
+
+		CHECK(data == R"json({"flag":false,"integer":0,"name":""})json");
+
+		// Omitted fields keep their declared values when decoding, so the entity round trips
+		const auto result = decode<json, SimpleEntity>(data);
+
+		CHECK(result.name		== "");
+		CHECK(result.integer	== 0);
+		CHECK(result.flag		== false);
+		CHECK(result.bignumber	== 20349758);
+		CHECK(result.floating	== 3.142);
+
+		// Every entity of a type is compared with the same declared values
+		ComplexEntity c;
+		c.entities.resize(3);
+		c.entities[1].integer = 7;
+
+		CHECK(encode<json>(c, { .omit_defaults = true }) == R"json({"entities":[{},{"integer":7},{}]})json");
+	}
+
+
+	struct ArenaEntity
+	{
+		struct Node
+		{
+			int value = 0;
+			emap(eref(value))
+		};
+
+		pmr_string name;
+		std::pmr::vector<int> values;
+		std::pmr::map<string, double> lookup;
+		std::pmr::vector<pmr_string> tags;
+		std::vector<std::shared_ptr<Node>> nodes;
+
+		emap(eref(name), eref(values), eref(lookup), eref(tags), eref(nodes))
+	};
+
+
+	TEST_CASE("an entity can be decoded into a memory resource")
+	{
+		const string data = R"json({
+			"name": "a name that is long enough to be allocated",
+			"values": [ 1, 2, 3 ],
+			"lookup": { "a": 1.5, "b": 2.5 },
+			"tags": [ "first", "second" ],
+			"nodes": [ { "value": 4 }, { "value": 5 } ]
+		})json";
+
+		std::pmr::monotonic_buffer_resource arena;
+		ArenaEntity e;
+
+		decode<json>(data, e, &arena);
+
+		CHECK(e.name					== "a name that is long enough to be allocated");
+		CHECK(e.values					== std::pmr::vector<int> { 1, 2, 3 });
+		CHECK(e.lookup.at("b")			== 2.5);
+		CHECK(e.tags[1]					== "second");
+		CHECK(e.nodes[1]->value			== 5);
+
+		CHECK(e.name.get_allocator().resource()		== &arena);
+		CHECK(e.values.get_allocator().resource()	== &arena);
+		CHECK(e.lookup.get_allocator().resource()	== &arena);
+		CHECK(e.tags[0].get_allocator().resource()	== &arena);
+
+		// Without a resource the default is used and the result matches
+		ArenaEntity d;
+		decode<json>(data, d);
+
+		CHECK(d.values.get_allocator().resource()	== std::pmr::get_default_resource());
+		CHECK(encode<json>(d)						== encode<json>(e));
+	}
+
+
+	struct StandardEntity
+	{
+		std::optional<int> count;
+		std::optional<SimpleEntity> simple;
+		std::unordered_map<string, int> lookup;
+		std::unordered_set<string> tags;
+		std::deque<double> samples;
+
+		emap(eref(count), eref(simple), eref(lookup), eref(tags), eref(samples))
+	};
+
+
+	TEST_CASE("an entity can contain optional, unordered and deque members")
+	{
+		StandardEntity e;
+
+		CHECK(encode<json>(e) == R"json({"count":null,"lookup":{},"samples":[],"simple":null,"tags":[]})json");
+
+		e.count			= 8;
+		e.simple.emplace().name = "optional";
+		e.lookup		= { { "a", 1 }, { "b", 2 } };
+		e.tags			= { "x", "y" };
+		e.samples		= { 1.5, 2.5 };
+
+		auto d = decode<json, StandardEntity>(encode<json>(e));
+
+		CHECK(d.count				== 8);
+		CHECK(d.simple->name		== "optional");
+		CHECK(d.lookup				== e.lookup);
+		CHECK(d.tags				== e.tags);
+		CHECK(d.samples				== e.samples);
+
+		// A null resets an optional and existing values are decoded into
+		decode<json>(R"json({"count":null,"simple":{"integer":1}})json", d);
+
+		CHECK(!d.count);
+		CHECK(d.simple->name		== "optional");
+		CHECK(d.simple->integer		== 1);
+
+		auto t = from_tree<StandardEntity>(to_tree(e));
+
+		CHECK(t.count				== 8);
+		CHECK(t.lookup				== e.lookup);
+		CHECK(t.samples				== e.samples);
+	}
+
+
 	TEST_CASE("a class with private members can be serialised")
 	{
 		ClassEntity e;
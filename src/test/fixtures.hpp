@@ -0,0 +1,36 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <entity/entity.hpp>
+
+
+// Fixtures shared by the tests of the binary codecs
+namespace fixtures
+{
+	using std::map;
+	using std::string;
+	using std::vector;
+
+
+	inline const string bytes(const vector<uint8_t> &data)
+	{
+		return string((char *)data.data(), data.size());
+	}
+
+
+	struct Simple
+	{
+		string name			= "simple";
+		bool flag			= true;
+		int integer			= 42;
+		int64_t bignumber	= -20349758123;
+		double floating		= 3.142;
+		vector<uint8_t> binary	= { 0x00, 0xff };
+		vector<int> ints		= { 1, -200, 70000 };
+		map<string, string> dictionary;
+
+		emap(eref(name), eref(flag), eref(integer), eref(bignumber), eref(floating), eref(binary), eref(ints), eref(dictionary))
+	};
+}
@@ -0,0 +1,163 @@
+#include "doctest.h"
+#include "fixtures.hpp"
+#include <entity/entity.hpp>
+#include <entity/json.hpp>
+#include <entity/msgpack.hpp>
+
+using namespace std;
+using namespace ent;
+using namespace fixtures;
+
+
+TEST_SUITE("msgpack")
+{
+	TEST_CASE("simple types can be converted to/from msgpack")
+	{
+		map<string, tree> test_vectors = {
+					// |Map |  Key    |  Value                                       |
+			{ bytes({ 0x81,0xa1,0x61,0x2a }),									tree {{ "a", 42 }} },							// Positive fixint
+			{ bytes({ 0x81,0xa1,0x61,0xe0 }),									tree {{ "a", -32 }} },							// Negative fixint
+			{ bytes({ 0x81,0xa1,0x61,0xcc,0xc8 }),								tree {{ "a", 200 }} },							// Uint8
+			{ bytes({ 0x81,0xa1,0x61,0xd1,0xfc,0x18 }),							tree {{ "a", -1000 }} },						// Int16
+			{ bytes({ 0x81,0xa1,0x61,0xcf,0x00,0x00,0x00,0x02,0xdf,0xdc,0x1c,0x34 }),	tree {{ "a", 12345678900 }} },				// Uint64
+			{ bytes({ 0x81,0xa1,0x61,0xca,0x3f,0xc0,0x00,0x00 }),				tree {{ "a", 1.5 }} },							// Float32
+			{ bytes({ 0x81,0xa1,0x61,0xcb,0x40,0x09,0x1e,0xb8,0x51,0xeb,0x85,0x1f }),	tree {{ "a", 3.14 }} },						// Float64
+			{ bytes({ 0x81,0xa1,0x61,0xa1,0x62 }),								tree {{ "a", "b" }} },							// Fixstr
+			{ bytes({ 0x81,0xa1,0x61,0xc3 }),									tree {{ "a", true }} },							// Boolean
+			{ bytes({ 0x81,0xa1,0x61,0xc0 }),									tree {{ "a", nullptr }} },						// Nil
+			{ bytes({ 0x81,0xa1,0x61,0xc4,0x02,0x00,0xff }),					tree {{ "a", vector<uint8_t> { 0x00, 0xff } }} },// Bin8
+			{ bytes({ 0x81,0xa1,0x61,0x91,0x2a }),								tree {{ "a", vector<tree> { 42 } }} },			// Fixarray
+			{ bytes({ 0x81,0xa1,0x61,0x81,0xa1,0x62,0x2a }),					tree {{ "a", {{ "b", 42 }} }} },				// Fixmap
+		};
+
+
+		SUBCASE("simple types can be serialised")
+		{
+			for (auto &i : test_vectors)
+			{
+				CHECK( encode<msgpack>(i.second) == i.first );
+			}
+		}
+
+
+		SUBCASE("simple types can be deserialised")
+		{
+			for (auto &i : test_vectors)
+			{
+				CHECK( (decode<msgpack>(i.first)["a"] == i.second["a"]) );
+			}
+		}
+	}
+
+
+	TEST_CASE("larger containers and strings use the wider headers")
+	{
+		const auto data = encode<msgpack>(tree {
+			{ "array",	vector<tree>(20, 1) },
+			{ "text",	string(40, 'x') },
+			{ "binary",	vector<uint8_t>(300, 1) }
+		});
+
+		CHECK(data.find(bytes({ 0xdc, 0x00, 0x14 })) != string::npos);	// Array16
+		CHECK(data.find(bytes({ 0xd9, 0x28 })) != string::npos);			// Str8
+		CHECK(data.find(bytes({ 0xc5, 0x01, 0x2c })) != string::npos);	// Bin16
+
+		auto t = decode<msgpack>(data);
+
+		CHECK(t["array"].as_array().size()	== 20);
+		CHECK(t["text"].as_string()			== string(40, 'x'));
+		CHECK(t["binary"].as_binary()		== vector<uint8_t>(300, 1));
+	}
+
+
+	TEST_CASE("an entity can be converted to/from msgpack")
+	{
+		Simple e;
+		e.dictionary = {{ "a", "1" }, { "b", "2" }};
+
+		auto result = decode<msgpack, Simple>(encode<msgpack>(e));
+
+		CHECK(result.name		== e.name);
+		CHECK(result.flag		== e.flag);
+		CHECK(result.integer	== e.integer);
+		CHECK(result.bignumber	== e.bignumber);
+		CHECK(result.floating	== e.floating);
+		CHECK(result.binary		== e.binary);
+		CHECK(result.ints		== e.ints);
+		CHECK(result.dictionary	== e.dictionary);
+	}
+
+
+	TEST_CASE("a vector of entities can be converted to/from msgpack")
+	{
+		vector<Simple> e(3);
+		e[1].name = "second";
+
+		auto result = decode<msgpack, vector<Simple>>(encode<msgpack>(e));
+
+		CHECK(result.size()		== 3);
+		CHECK(result[1].name	== "second");
+	}
+
+
+	TEST_CASE("containers are sized from the element count")
+	{
+		const auto ints = decode<msgpack, vector<int>>(encode<msgpack>(vector<int>(1000, 7)));
+
+		CHECK(ints.size()		== 1000);
+		CHECK(ints.capacity()	== 1000);
+
+		// Sorted keys are merged into an existing map
+		map<string, int> m = {{ "b", 0 }, { "d", 0 }};
+		decode<msgpack>(encode<msgpack>(map<string, int> {{ "a", 1 }, { "b", 2 }, { "c", 3 }, { "e", 5 }}), m);
+
+		CHECK(m == map<string, int> {{ "a", 1 }, { "b", 2 }, { "c", 3 }, { "d", 0 }, { "e", 5 }});
+
+		// The count is limited by the remaining data rather than trusted
+		CHECK_THROWS(decode<msgpack, vector<int>>(bytes({ 0xdd,0x7f,0xff,0xff,0xff,0x01 }), true));
+	}
+
+
+	TEST_CASE("unknown fields are skipped when decoding an entity")
+	{
+		const auto data = encode<msgpack>(tree {
+			{ "a", {{ "nested", vector<tree> { 1, "two", 3.5 } }} },
+			{ "integer", 8 },
+			{ "unknown", vector<uint8_t> { 1, 2, 3 } }
+		});
+
+		CHECK(decode<msgpack, Simple>(data).integer == 8);
+	}
+
+
+	TEST_CASE("an entity can be encoded more compactly than JSON")
+	{
+		CHECK(encode<msgpack>(Simple()).size() < encode<json>(Simple()).size());
+	}
+
+
+	TEST_CASE("parser will throw exception if the msgpack is invalid")
+	{
+		vector<string> invalid_vectors = {
+			bytes({ 0x81,0xa1 }),									// Truncated key
+			bytes({ 0x82,0xa1,0x61,0x2a }),							// Missing map element
+			bytes({ 0x81,0xa1,0x61,0xcd,0x01 }),					// Truncated Uint16
+			bytes({ 0x81,0xa1,0x61,0xdb,0xff,0xff,0xff,0xff }),		// Huge string length
+			bytes({ 0x81,0xa1,0x61,0xc6,0x00,0x00,0x00,0x08,0x01 }),	// Truncated binary
+			bytes({ 0x81,0xa1,0x61,0xdd,0x00,0x01,0x00,0x00 }),		// Array with missing elements
+			bytes({ 0x81,0xa1,0x61,0xc9,0x7f,0xff,0xff,0xff,0x01 }),	// Ext32 length at the limit of int
+			bytes({ 0x81,0xa1,0x61,0xc9,0xff,0xff,0xff,0xff,0x01 }),	// Huge Ext32 length
+			string(100000, '\x91') + '\xc0',							// Excessive nesting
+		};
+
+		for (auto &i : invalid_vectors)
+		{
+			CHECK_THROWS(decode<msgpack>(i));
+			CHECK_THROWS(decode<msgpack, Simple>(i));
+			CHECK_THROWS(decode<msgpack>(i, true));
+		}
+
+		// Nesting within the limit is accepted
+		CHECK(decode<msgpack>(string(100, '\x91') + '\xc0').get_type() == tree::Type::Array);
+	}
+}
@@ -1,6 +1,11 @@
 #include "doctest.h"
 #include <entity/query.hpp>
+#include <entity/query/encoded.hpp>
+#include <entity/json.hpp>
+#include <entity/bson.hpp>
+#include <entity/msgpack.hpp>
 #include <ostream>
+#include <thread>
 #include <cmath>
 
 using namespace ent;
@@ -25,6 +30,11 @@ TEST_SUITE("query")
 	}
 
 
+	// Whether the pipeline of a query can be bound to another container
+	template <class Q> struct bindable;
+	template <class T, class S> struct bindable<query<T, S>> : stages::is_bindable<S> {};
+
+
 	TEST_CASE("query brings LINQ-like features to STL containers")
 	{
 		std::vector<simple> objects	= {{ "a", 42 }, { "a", 8 }, { "b", 8 }, { "cb", 8 }, { "ca", 8 }};
@@ -135,10 +145,55 @@ TEST_SUITE("query")
 		}
 
 
-		// SUBCASE("can group items by key") {}
+		SUBCASE("can group items by key")
+		{
+			auto groups = from(objects).group_by([](auto &i) { return i.number; }).vector();
+
+			REQUIRE(groups.size() == 2);
+			CHECK(groups[0].key		== 42);
+			CHECK(groups[1].key		== 8);
+			CHECK(groups[1].items	== std::vector<simple>({{ "a", 8 }, { "b", 8 }, { "cb", 8 }, { "ca", 8 }}));
+
+			CHECK(from(strings).group_by([](auto &i) { return i.size() > 3; }, [](auto &i) { return i.front(); }).last().items == std::vector<char>({ 'm', 'b' }));
+		}
+
+
 		// SUBCASE("can join two sequences and then group items by key") {}
-		// SUBCASE("can produce the intersect of two sequences") {}
-		// SUBCASE("can join two sequences") {}
+
+
+		SUBCASE("can produce the intersect of two sequences")
+		{
+			CHECK(from(ints).intersect(more_ints).vector()					== std::vector<int>({ 3, 2, 42 }));
+			CHECK(from(ints).intersect(from(more_ints).reverse()).count()	== 3);
+			CHECK(from(ints).intersect(empty).count()						== 0);
+		}
+
+
+		SUBCASE("can join two sequences")
+		{
+			auto joined = from(objects).join(
+				from(letters),
+				[](auto &i) { return i.name.front(); },
+				[](auto &i) { return i.front(); },
+				[](auto &i, auto &j) { return j + std::to_string(i.number); }
+			);
+
+			CHECK(joined.vector()			== std::vector<string>({ "a42", "a8", "b8", "c8", "c8" }));
+			CHECK(joined.reverse().first()	== "c8");
+			CHECK(from(ints).join(from(more_ints), [](auto &i) { return i; }, [](auto &i) { return i; }, [](auto &i, auto &j) { return i + j; }).sum() == 98);
+		}
+
+
+		SUBCASE("can use custom hash and equality functions with set operations")
+		{
+			auto hash	= [](const string &s) { return std::hash<char>()(s.front()); };
+			auto equal	= [](const string &a, const string &b) { return a.front() == b.front(); };
+
+			CHECK(from(strings).distinct(hash, equal).vector()					== std::vector<string>({ "the", "moon's", "a", "balloon" }));
+			CHECK(from(strings).except(letters, hash, equal).vector()			== std::vector<string>({ "the", "moon's" }));
+			CHECK(from(strings).intersect(letters, hash, equal).vector()		== std::vector<string>({ "a", "balloon" }));
+			CHECK(from(letters).union_with(strings, hash, equal).vector()		== std::vector<string>({ "a", "b", "c", "the", "moon's" }));
+		}
 
 
 		SUBCASE("can return the last item")
@@ -247,6 +302,37 @@ TEST_SUITE("query")
 		}
 
 
+		SUBCASE("can take the first items of an ordered sequence")
+		{
+			auto ordered = from(ints).order_by([](auto &i) { return i; }, true);
+
+			CHECK(ordered.take(3).vector()				== std::vector<int>({ 42, 8, 7 }));
+			CHECK(ordered.take(5).take(2).vector()		== std::vector<int>({ 42, 8 }));
+			CHECK(ordered.take(20).count()				== 9);
+			CHECK(ordered.take(-1).count()				== 0);
+
+			// Fusing the take into the sort does not change the results, so a take iterated in
+			// reverse returns the last items, just as it does for any other sequence
+			auto unfused = ordered.where([](auto &) { return true; });
+
+			CHECK(ordered.take(3).reverse().vector()	== std::vector<int>({ 2, 2, 3 }));
+			CHECK(ordered.take(3).reverse().vector()	== unfused.take(3).reverse().vector());
+			CHECK(ordered.take(20).reverse().vector()	== unfused.take(20).reverse().vector());
+			CHECK(ordered.take(3).last()				== unfused.take(3).last());
+			CHECK(ordered.take(3).explain()				== "scan -> order_by (partial sort)");
+
+			// Equal keys retain their original order, including items copied from a transform
+			CHECK(from(objects).order_by([](auto &i) { return i.number; }).take(3).vector() == std::vector<simple>({{ "a", 8 }, { "b", 8 }, { "cb", 8 }}));
+			CHECK(from(objects).order_by([](auto &i) { return i.number; }).take(3).reverse().vector() == std::vector<simple>({{ "a", 42 }, { "ca", 8 }, { "cb", 8 }}));
+			CHECK(from(objects).select([](auto &i) { return simple { i.name + "!", i.number }; }).order_by([](auto &i) { return i.number; }).take(2).last() == simple { "a!", 42 });
+
+			// A take ends the ordered chain, so a following then_by has no effect
+			auto by_number = from(objects).order_by([](auto &i) { return i.number; });
+
+			CHECK(by_number.take(3).then_by<string>([](auto &i) { return i.name; }).vector() == by_number.take(3).vector());
+		}
+
+
 		SUBCASE("can convert the resulting sequence to a container type")
 		{
 			auto expected	= std::map<string, int> {{ "a", 8 }, { "b", 8 }, { "ca", 8 }, { "cb", 8 }};
@@ -261,7 +347,11 @@ TEST_SUITE("query")
 		}
 
 
-		// SUBCASE("can return the union of two sequences") {}
+		SUBCASE("can return the union of two sequences")
+		{
+			CHECK(from(ints).union_with(more_ints).vector() == std::vector<int>({ 6, 3, 8, 2, 42, 4, 7, 100 }));
+			CHECK(from(empty).union_with(from({ 1, 1 })).vector() == std::vector<int>({ 1 }));
+		}
 
 
 		SUBCASE("can filter the sequence")
@@ -305,6 +395,241 @@ TEST_SUITE("query")
 		}
 
 
+		SUBCASE("can deduce result types from the functions supplied")
+		{
+			auto sizes = from(strings).select([](auto &i) { return i.size(); });
+
+			CHECK(sizes.vector() == std::vector<size_t>({ 3, 6, 1, 7 }));
+			CHECK(from(strings).order_by([](auto &i) { return i.size(); }).first()	== "a");
+			CHECK(from(strings).max([](auto &i) { return i.size(); })				== 7);
+			CHECK(from(ints).zip(from(more_ints), [](auto &i, auto &j) { return i * j; }).first() == 252);
+		}
+
+
+		SUBCASE("can store any query as a type-erased query")
+		{
+			query<int> q = from(ints).where([](auto &i) { return i > 5; });
+			query<int> copy = q;
+
+			CHECK(q.count()								== 5);
+			CHECK(copy.take(2).vector()					== std::vector<int>({ 6, 8 }));
+			CHECK(q.select([](auto &i) { return -i; }).min()	== -42);
+		}
+
+
+		SUBCASE("can take while the predicate holds until the end of the sequence")
+		{
+			CHECK(from(ints).take_while([](auto &) { return true; }).count()	== 9);
+			CHECK(from(empty).take_while([](auto &) { return true; }).count()	== 0);
+		}
+
+
+		SUBCASE("can evaluate the query across multiple threads")
+		{
+			std::vector<int> large(100000);
+			for (int i = 0; i < (int)large.size(); i++) large[i] = i;
+
+			auto q = from(large).where([](auto &i) { return i % 3 == 0; }).select([](auto &i) { return (int64_t)i * 2; });
+
+			CHECK(q.parallel(8).count()									== q.count());
+			CHECK(q.parallel(8).sum()									== q.sum());
+			CHECK(q.parallel(8).average()								== doctest::Approx(q.average()));
+			CHECK(q.parallel(8).min()									== 0);
+			CHECK(q.parallel(8).max()									== q.max());
+			CHECK(q.parallel(8).vector()								== q.vector());
+			CHECK(q.parallel(8).any([](auto &i) { return i == 600; })	== true);
+			CHECK(q.parallel(8).all([](auto &i) { return i < 600; })	== false);
+			CHECK(q.parallel(8).aggregate(int64_t(0), [](auto &a, auto &i) { return a + i; }, std::plus<int64_t>()) == q.sum());
+			CHECK(from(ints).parallel().sum()							== 80);
+			CHECK_THROWS(from(empty).parallel().max());
+			CHECK_THROWS(from(large).select([](auto &i) { return i < 90000 ? i : throw std::runtime_error("failed"); }).parallel(8).count());
+		}
+
+
+		SUBCASE("can evaluate the query a block at a time")
+		{
+			std::vector<int> large(10000);
+			for (int i = 0; i < (int)large.size(); i++) large[i] = i;
+
+			auto q = from(large).where([](auto &i) { return i % 3 == 0; }).select([](auto &i) { return (int64_t)i * 2; });
+
+			CHECK(q.batch().count()										== q.count());
+			CHECK(q.batch(7).count([](auto &i) { return i % 4 == 0; })	== q.count([](auto &i) { return i % 4 == 0; }));
+			CHECK(q.batch().sum()										== q.sum());
+			CHECK(q.batch(100).average()								== doctest::Approx(q.average()));
+			CHECK(q.batch().min()										== 0);
+			CHECK(q.batch(3).max()										== q.max());
+			CHECK(q.batch(5).vector()									== q.vector());
+			CHECK(q.batch().any([](auto &i) { return i == 600; })		== true);
+			CHECK(q.batch().all([](auto &i) { return i < 600; })		== false);
+			CHECK(q.batch().aggregate(int64_t(0), [](auto &a, auto &i) { return a + i; }) == q.sum());
+			CHECK(q.skip(10).take(100).batch(16).vector()				== q.skip(10).take(100).vector());
+			CHECK(q.take(5).skip(2).batch(2).vector()					== std::vector<int64_t>({ 12, 18, 24 }));
+			CHECK(q.skip(20000).batch().count()							== 0);
+			CHECK(from(ints).batch().sum()								== 80);
+			CHECK(from({ 1, 2, 3 }).batch().max()						== 3);
+
+			query<int64_t> erased	= q;
+			query<int> ordered		= from(ints).order_by([](auto &i) { return -i; }).select([](auto &i) { return i + 1; });
+
+			CHECK(erased.batch(64).sum()								== q.sum());
+			CHECK(erased.where([](auto &i) { return i > 100; }).batch().count() == q.count([](auto &i) { return i > 100; }));
+			CHECK(ordered.batch(4).vector()								== ordered.vector());
+			CHECK_THROWS(from(empty).batch().max());
+			CHECK_THROWS(from(empty).batch().average());
+		}
+
+
+		SUBCASE("can use the size and random access of the source where available")
+		{
+			int calls	= 0;
+			auto q		= from(ints).select([&](auto &i) { calls++; return i * 2; });
+
+			CHECK(q.count()									== 9);
+			CHECK(q.skip(3).count()							== 6);
+			CHECK(q.take(4).count()							== 4);
+			CHECK(q.skip(20).count()						== 0);
+			CHECK(q.concat(from(more_ints)).count()			== 13);
+			CHECK(from(empty).default_if_empty().count()	== 1);
+			CHECK(calls										== 0);
+
+			CHECK(q.element_at(4)							== 84);
+			CHECK(q.reverse().element_at(1)					== 12);
+			CHECK(q.skip(2).take(3).element_at(2)			== 84);
+			CHECK(q.skip(2).vector()						== std::vector<int>({ 16, 4, 84, 8, 4, 12, 14 }));
+			CHECK(q.reverse().skip(7).vector()				== std::vector<int>({ 6, 12 }));
+			CHECK(calls										== 12);
+
+			CHECK(q.element_at_or_default(9)				== 0);
+			CHECK(q.take(2).element_at_or_default(2)		== 0);
+			CHECK_THROWS(q.skip(8).element_at(1));
+
+			CHECK(from(ints).zip(from(more_ints), [](auto &i, auto &j) { return i + j; }).element_at(3) == 5);
+			CHECK(from(ints).sequence_equal(from(ints).take(8)) == false);
+		}
+
+
+		SUBCASE("can reduce numeric values accessed directly by index")
+		{
+			std::vector<double> values(1001);
+			for (size_t i = 0; i < values.size(); i++) values[i] = i * 0.5;
+
+			auto halves = from(values).select([](auto &i) { return i * 0.5; });
+
+			CHECK(from(values).sum()								== 250250.0);
+			CHECK(from(values).min()								== 0.0);
+			CHECK(from(values).max()								== 500.0);
+			CHECK(from(values).average()							== 250.0);
+			CHECK(halves.sum()										== 125125.0);
+			CHECK(halves.max()										== 250.0);
+			CHECK(halves.select([](auto &i) { return -i; }).min()	== -250.0);
+			CHECK(from(objects).sum([](auto &i) { return i.number; })	== 74);
+			CHECK(from(objects).min([](auto &i) { return i.number; })	== 8);
+			CHECK_THROWS(from(empty).select([](auto &i) { return i * 2; }).max());
+		}
+
+
+		SUBCASE("can sum values with compensation for rounding errors")
+		{
+			std::vector<double> values = { 1.0, 1e100, 1.0, -1e100 };
+
+			for (int i = 0; i < 20; i++) values.push_back(0.1);
+
+			CHECK(from(values).stable_sum()											== doctest::Approx(4.0).epsilon(1e-12));
+			CHECK(from(values).where([](auto &) { return true; }).stable_sum()		== doctest::Approx(4.0).epsilon(1e-12));
+			CHECK(from(values).stable_sum([](auto &i) { return i * 2; })			== doctest::Approx(8.0).epsilon(1e-12));
+			CHECK(from(ints).stable_sum()											== 80);
+		}
+
+
+		SUBCASE("can search sources that are sorted by key")
+		{
+			std::map<int, string> numbers	= {{ 1, "one" }, { 3, "three" }, { 5, "five" }, { 7, "seven" }};
+			std::set<string> names			= { "ca", "a", "b", "cb" };
+			auto value						= [](auto &i) { return i.second; };
+
+			CHECK(from(numbers).where_key(3).select(value).single()						== "three");
+			CHECK(from(numbers).where_key(4).count()									== 0);
+			CHECK(from(numbers).where_key_range(2, 6).select(value).vector()			== std::vector<string>({ "three", "five" }));
+			CHECK(from(numbers).where_key_range(2, 6).where_key_range(4, 9).count()		== 1);
+			CHECK(from(numbers).where_key_range(6, 2).count()							== 0);
+			CHECK(from(numbers).where_key_range(2, 6).reverse().select(value).first()	== "five");
+			CHECK(from(numbers).order_by_key(true).select(value).vector()				== std::vector<string>({ "seven", "five", "three", "one" }));
+			CHECK(from(names).where_key_range("b", "c").vector()						== std::vector<string>({ "b" }));
+			CHECK(from(names).order_by_key(true).last()									== "a");
+			CHECK_THROWS(ent::plan<std::set<string>>().where_key("a"));
+			CHECK_THROWS(ent::plan<std::set<string>>().order_by_key());
+		}
+
+
+		SUBCASE("can search a secondary index")
+		{
+			auto index = index_by(objects, [](auto &i) { return i.number; });
+
+			CHECK(from(index).first()									== simple { "a", 8 });
+			CHECK(from(index).last()									== simple { "a", 42 });
+			CHECK(from(index).where_key(8).count()						== 4);
+			CHECK(from(index).where_key(8).last()						== simple { "ca", 8 });
+			CHECK(from(index).where_key_range(9, 50).single().number	== 42);
+			CHECK(from(index).order_by_key(true).first().number			== 42);
+		}
+
+
+		SUBCASE("can explain the plan for a query")
+		{
+			std::map<int, int> numbers;
+
+			CHECK(from(ints).where([](auto &i) { return i > 2; }).order_by([](auto &i) { return i; }).explain()	== "scan -> where -> order_by");
+			CHECK(from(ints).skip(2).except(from(more_ints)).explain()											== "scan -> skip (seek) -> except(scan) (hash)");
+			CHECK(from(numbers).where([](auto &i) { return i.first == 2; }).explain()							== "scan -> where");
+			CHECK(from(numbers).where_key(2).explain()															== "sorted range (binary search)");
+			CHECK(query<int>(ints).explain()																	== "erased");
+		}
+
+
+		SUBCASE("can define a plan once and evaluate it against many containers")
+		{
+			auto plan = ent::plan<std::vector<int>>()
+				.where([](auto &i) { return i > 2; })
+				.order_by([](auto &i) { return i; })
+				.select([](auto &i) { return i * 10; });
+
+			CHECK(plan.bind(ints).vector()		== std::vector<int>({ 30, 40, 60, 60, 70, 80, 420 }));
+			CHECK(plan.bind(more_ints).vector()	== std::vector<int>({ 30, 420, 1000 }));
+			CHECK(plan.bind(empty).count()		== 0);
+			CHECK_THROWS(plan.count());
+
+			std::vector<int> results(4);
+			std::vector<std::thread> threads;
+
+			for (int t = 0; t < 4; t++)
+			{
+				threads.emplace_back([&, t] {
+					for (int j = 0; j < 100; j++) results[t] += plan.bind(t % 2 ? ints : more_ints).take(3).sum();
+				});
+			}
+
+			for (auto &t : threads) t.join();
+
+			CHECK(results == std::vector<int>({ 145000, 13000, 145000, 13000 }));
+		}
+
+
+		SUBCASE("cannot bind a plan that combines other sequences")
+		{
+			auto plan = ent::plan<std::vector<int>>().where([](auto &i) { return i > 2; });
+			auto other = from(more_ints);
+
+			CHECK(bindable<decltype(plan)>::value);
+			CHECK(bindable<decltype(plan.order_by([](auto &i) { return i; }).take(3))>::value);
+			CHECK_FALSE(bindable<decltype(plan.concat(other))>::value);
+			CHECK_FALSE(bindable<decltype(plan.intersect(other))>::value);
+			CHECK_FALSE(bindable<decltype(plan.zip(other, [](auto &a, auto &b) { return a + b; }))>::value);
+			CHECK_FALSE(bindable<decltype(plan.join(other, [](auto &i) { return i; }, [](auto &i) { return i; }, [](auto &a, auto &b) { return a + b; }))>::value);
+			CHECK_FALSE(bindable<decltype(from(ints).concat(other).where([](auto &i) { return i > 2; }))>::value);
+		}
+
+
 		SUBCASE("can iterate with a range-based for")
 		{
 			int sum			= 0;
@@ -319,4 +644,83 @@ TEST_SUITE("query")
 		}
 	}
 
+
+	struct Event
+	{
+		string source;
+		int level = 0;
+		std::vector<int> values;
+
+		emap(eref(source), eref(level), eref(values))
+	};
+
+	struct EventLevel
+	{
+		int level = 0;
+
+		emap(eref(level))
+	};
+
+	struct EventLog
+	{
+		string name;
+		std::vector<Event> events;
+
+		emap(eref(name), eref(events))
+	};
+
+
+	TEST_CASE("query can iterate over an encoded top-level array")
+	{
+		const string data = R"json([ { "source": "sensor", "level": 2 }, { "source": "camera", "level": 3 } ])json";
+
+		CHECK(from<json, Event>(data).select([](auto &i) { return i.level; }).sum()	== 5);
+		CHECK(from<json, Event>(data).last().source										== "camera");
+		CHECK_THROWS(from<json, Event>(string("[ invalid")).count());
+	}
+
+
+	TEST_CASE_TEMPLATE("query can iterate over an encoded array", Codec, json, bson, msgpack)
+	{
+		std::vector<Event> events = {
+			{ "sensor", 1, { 1, 2, 3 } },
+			{ "camera", 3, { 4 } },
+			{ "sensor", 2, {} },
+			{ "camera", 1, { 5, 6 } }
+		};
+
+		// The array is a field of a top-level object since bson only supports documents
+		const string data = encode<Codec>(EventLog { "log", events });
+
+
+		SUBCASE("decoding one item at a time")
+		{
+			auto q = from<Codec, Event>(data, "events");
+
+			CHECK(q.count()																	== 4);
+			CHECK(q.where([](auto &i) { return i.source == "camera"; }).select([](auto &i) { return i.level; }).sum() == 4);
+			CHECK(q.last().source															== "camera");
+			CHECK(q.take(1).vector().front().values											== std::vector<int>({ 1, 2, 3 }));
+			CHECK(q.select([](auto &i) { return i.values.size(); }).vector()				== std::vector<size_t>({ 3, 1, 0, 2 }));	// no stale values
+			CHECK(q.reverse().select([](auto &i) { return i.level; }).vector()				== std::vector<int>({ 1, 2, 3, 1 }));
+		}
+
+
+		SUBCASE("filtering items with a probe before decoding them")
+		{
+			auto q = from<Codec, Event, EventLevel>(data, [](auto &i) { return i.level > 1; }, "events");
+
+			CHECK(q.count()													== 2);
+			CHECK(q.select([](auto &i) { return i.source; }).vector()		== std::vector<string>({ "camera", "sensor" }));
+			CHECK(q.first().values											== std::vector<int>({ 4 }));
+		}
+
+
+		SUBCASE("with invalid or empty data")
+		{
+			CHECK(from<Codec, Event>(encode<Codec>(EventLog())).count()			== 0);
+			CHECK(from<Codec, Event>(data, "missing").count()					== 0);
+			CHECK(from<Codec, Event>(data, "name").count()						== 0);
+		}
+	}
 }
@@ -1,7 +1,15 @@
 #include "doctest.h"
 #include <entity/utilities/base64.hpp>
 #include <entity/utilities/compare.hpp>
+#include <entity/utilities/columnar.hpp>
+#include <entity/utilities/patch.hpp>
+#include <entity/json.hpp>
+#include <entity/bson.hpp>
+#include <entity/msgpack.hpp>
+#include <entity/compact.hpp>
 #include <map>
+#include <optional>
+#include <unordered_map>
 
 using namespace std;
 using namespace ent;
@@ -87,5 +95,283 @@ TEST_SUITE("utilities")
 			CHECK(diffs[1].before.as_string() 	== "simple");
 			CHECK(diffs[1].after.as_string()	== "changed");
 		}
+
+
+		SUBCASE("entities containing collections")
+		{
+			struct Child
+			{
+				string name;
+				int value = 0;
+
+				emap(eref(name), eref(value))
+			};
+
+			struct Parent
+			{
+				vector<Child> children;
+				map<string, int> counts;
+				shared_ptr<Child> pointer;
+				tree parameters;
+
+				emap(eref(children), eref(counts), eref(pointer), eref(parameters))
+			};
+
+			Parent before;
+			before.children		= { { "a", 1 }, { "b", 2 } };
+			before.counts		= { { "x", 1 }, { "y", 2 } };
+			before.parameters	= tree().set("gain", 1).set("mode", "auto");
+
+			Parent after			= before;
+			after.children[1].value	= 3;
+			after.children.push_back({ "c", 4 });
+			after.counts			= { { "y", 5 }, { "z", 6 } };
+			after.pointer			= make_shared<Child>();
+			after.parameters.set("gain", 2);
+
+			auto diffs = compare::entities(before, after);
+
+			REQUIRE(diffs.size() == 7);
+			CHECK(diffs[0].level					== "children:1:value");
+			CHECK(diffs[0].after.as_long()			== 3);
+			CHECK(diffs[1].level					== "children:2");
+			CHECK(diffs[1].before.get_type()		== tree::Type::Null);
+			CHECK(diffs[1].after["name"].as_string()	== "c");
+			CHECK(diffs[2].level					== "counts:x");
+			CHECK(diffs[2].after.get_type()			== tree::Type::Null);
+			CHECK(diffs[3].level					== "counts:y");
+			CHECK(diffs[4].level					== "counts:z");
+			CHECK(diffs[5].level					== "parameters:gain");
+			CHECK(diffs[5].before.as_long()			== 1);
+			CHECK(diffs[6].level					== "pointer");
+			CHECK(compare::entities(before, before).empty());
+		}
+
+
+		SUBCASE("entities containing optional and unordered members")
+		{
+			struct Standard
+			{
+				std::optional<int> count;
+				std::unordered_map<string, int> lookup;
+
+				emap(eref(count), eref(lookup))
+			};
+
+			Standard before { 1, { { "x", 1 }, { "y", 2 } } };
+			Standard after	{ std::nullopt, { { "y", 5 }, { "z", 6 } } };
+
+			auto diffs = compare::entities(before, after);
+
+			REQUIRE(diffs.size() == 4);
+			CHECK(diffs[0].level					== "count");
+			CHECK(diffs[0].after.get_type()			== tree::Type::Null);
+			CHECK(compare::entities(before, before).empty());
+		}
+	}
+
+
+	TEST_CASE("entities and trees can be patched")
+	{
+		struct Child
+		{
+			string name;
+			int value = 0;
+
+			emap(eref(name), eref(value))
+		};
+
+		struct Parent
+		{
+			string name;
+			vector<int> values;
+			map<string, int> counts;
+			Child child;
+
+			emap(eref(name), eref(values), eref(counts), eref(child))
+		};
+
+		Parent before { "parent", { 1, 2, 3 }, { { "x", 1 }, { "y", 2 } }, { "child", 1 } };
+		Parent after	= before;
+		after.values	= { 1, 5 };
+		after.counts	= { { "y", 2 }, { "z", 3 } };
+		after.child.value	= 2;
+
+
+		SUBCASE("merge patch")
+		{
+			const auto data = merge_patch<json>(before, after);
+
+			CHECK(data == R"json({"child":{"value":2},"counts":{"x":null,"z":3},"values":[1,5]})json");
+
+			Parent patched = before;
+			apply_patch<json>(data, patched);
+
+			CHECK(compare::entities(patched, after).empty());
+			CHECK(patched.values.size() == 2);
+			CHECK(patched.counts.size() == 2);
+
+			patched = before;
+			apply_patch<bson>(merge_patch<bson>(before, after), patched);
+
+			CHECK(compare::entities(patched, after).empty());
+			CHECK(merge_patch<json>(before, before) == "{}");
+
+			// Absent fields are untouched, a null resets a field to its default or removes a key
+			patched = before;
+			apply_patch<json>(R"json({"child":null,"counts":{"y":null},"name":null})json", patched);
+
+			CHECK(patched.name			== "");
+			CHECK(patched.child.name	== "");
+			CHECK(patched.values.size()	== 3);
+			CHECK(patched.counts		== map<string, int> {{ "x", 1 }});
+
+			patched = before;
+			patch::apply(patched, patch::merge(before, after));
+
+			CHECK(compare::entities(patched, after).empty());
+			CHECK_THROWS(apply_patch<compact>(encode<compact>(after), patched));
+		}
+
+
+		SUBCASE("json patch")
+		{
+			CHECK(json_patch<json>(before, after) == R"json([)json"
+				R"json({"op":"replace","path":"/child/value","value":2},)json"
+				R"json({"op":"remove","path":"/counts/x"},)json"
+				R"json({"op":"add","path":"/counts/z","value":3},)json"
+				R"json({"op":"replace","path":"/values/1","value":5},)json"
+				R"json({"op":"remove","path":"/values/2"}])json"
+			);
+
+			auto operations = patch::operations(tree {{ "a/b", 1 }}, tree {{ "a/b", 2 }});
+
+			REQUIRE(operations.size() == 1);
+			CHECK(operations[0]["path"].as_string() == "/a~1b");
+		}
+
+
+		SUBCASE("applying a json patch")
+		{
+			Parent patched = before;
+			apply_json_patch<json>(json_patch<json>(before, after), patched);
+
+			CHECK(compare::entities(patched, after).empty());
+			CHECK(patched.values.size() == 2);
+			CHECK(patched.counts == after.counts);
+
+			tree target = tree().set("a", vector<tree> { 1, 2 }).set("b", tree().set("c~d", 3));
+
+			patch::apply_operations(target, {
+				tree().set("op", "test").set("path", "/b/c~0d").set("value", 3),
+				tree().set("op", "move").set("from", "/b/c~0d").set("path", "/a/0"),
+				tree().set("op", "copy").set("from", "/a").set("path", "/b/e"),
+				tree().set("op", "add").set("path", "/a/-").set("value", 4),
+				tree().set("op", "remove").set("path", "/a/1")
+			});
+
+			CHECK(target["a"] == tree(vector<tree> { 3, 2, 4 }));
+			CHECK(target["b"] == tree().set("e", vector<tree> { 3, 1, 2 }));
+
+			// The target is unchanged if any operation fails
+			const tree original = target;
+
+			CHECK_THROWS(patch::apply_operations(target, { tree().set("op", "remove").set("path", "/a/0"), tree().set("op", "test").set("path", "/a/0").set("value", 3) }));
+			CHECK_THROWS(patch::apply_operations(target, { tree().set("op", "replace").set("path", "/a/3").set("value", 0) }));
+			CHECK_THROWS(patch::apply_operations(target, { tree().set("op", "move").set("from", "/b").set("path", "/b/e/0") }));
+			CHECK(target == original);
+		}
+
+
+		SUBCASE("trees")
+		{
+			tree original	= tree().set("a", 1).set("b", tree().set("c", 2).set("d", 3));
+			tree updated	= tree().set("a", 1).set("b", tree().set("c", 4));
+			tree target		= original;
+
+			patch::apply(target, patch::merge(original, updated));
+
+			CHECK(target == updated);
+		}
+	}
+
+
+	TEST_CASE("vectors of entities can be encoded as columns")
+	{
+		struct Reading
+		{
+			string sensor;
+			int64_t time	= 0;
+			double value	= 0;
+			bool valid		= true;
+			vector<int> tags;
+
+			emap(eref(sensor), eref(time), eref(value), eref(valid), eref(tags))
+		};
+
+		const vector<Reading> readings = {
+			{ "a", 1000, 1.5, true, { 1 } },
+			{ "b", 2000, -2.25, false, {} },
+			{ "c", 3000, 1e10, true, { 2, 3 } }
+		};
+
+		auto check = [&](const vector<Reading> &result) {
+			REQUIRE(result.size() == 3);
+
+			for (size_t i = 0; i < readings.size(); i++)
+			{
+				CHECK(result[i].sensor	== readings[i].sensor);
+				CHECK(result[i].time	== readings[i].time);
+				CHECK(result[i].value	== readings[i].value);
+				CHECK(result[i].valid	== readings[i].valid);
+				CHECK(result[i].tags	== readings[i].tags);
+			}
+		};
+
+		SUBCASE("text codecs write arrays of values")
+		{
+			const auto data = columnar::encode<json>(readings);
+
+			CHECK(data == R"json({"count":3,"fields":{"sensor":["a","b","c"],"tags":[[1],[],[2,3]],"time":[1000,2000,3000],"valid":[true,false,true],"value":[1.5,-2.25,1e+10]}})json");
+			check(columnar::decode<json, Reading>(data));
+		}
+
+		SUBCASE("binary codecs pack arithmetic columns")
+		{
+			const auto data = columnar::encode<msgpack>(readings);
+			auto t = decode<msgpack>(data);
+			const auto time = t["fields"]["time"].as_binary();
+
+			REQUIRE(time.size() == 3 * sizeof(int64_t));
+			CHECK(reinterpret_cast<const int64_t *>(time.data())[2] == 3000);
+			CHECK(t["fields"]["sensor"].get_type() == tree::Type::Array);
+
+			check(columnar::decode<msgpack, Reading>(data));
+			check(columnar::decode<bson, Reading>(columnar::encode<bson>(readings)));
+		}
+
+		SUBCASE("empty vectors are supported")
+		{
+			CHECK(columnar::decode<json, Reading>(columnar::encode<json>(vector<Reading>())).empty());
+		}
+
+		SUBCASE("invalid columns are rejected")
+		{
+			auto t = decode<msgpack>(columnar::encode<msgpack>(readings));
+
+			// Any non-zero byte in a packed bool column is true
+			t["fields"]["valid"] = vector<uint8_t> { 0, 2, 255 };
+			const auto result = columnar::decode<msgpack, Reading>(encode<msgpack>(t));
+
+			REQUIRE(result.size() == 3);
+			CHECK_FALSE(result[0].valid);
+			CHECK(result[1].valid);
+			CHECK(result[2].valid);
+
+			t["fields"]["time"] = vector<uint8_t>(2 * sizeof(int64_t));
+			CHECK_THROWS(columnar::decode<msgpack, Reading>(encode<msgpack>(t)));
+
+			CHECK_THROWS(columnar::decode<json, Reading>(R"json({"fields":{"time":[1,2,3]},"count":3})json"));
+		}
 	}
 }
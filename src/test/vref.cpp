@@ -2,6 +2,9 @@
 #include <entity/vref/vref.hpp>
 #include <entity/json.hpp>
 #include <entity/entity.hpp>
+#include <entity/tracked.hpp>
+#include <entity/bson.hpp>
+#include <entity/compact.hpp>
 
 using namespace std;
 using namespace ent;
@@ -513,6 +516,24 @@ TEST_CASE("vref can map a reference to different types") //, "[vref]")
 		// If the child of the child points back to the root then it should fail
 		root->child->child = root;
 		CHECK_THROWS(make_vref(root).encode(c, dst, "a", stack));
+
+		// A cycle that does not include the root should also fail
+		root->child->child = std::make_shared<Root>();
+		root->child->child->child = root->child;
+		CHECK_THROWS(make_vref(root).encode(c, dst, "a", stack));
+		root->child->child->child = nullptr;
+
+		// The same object may be referenced more than once without forming a cycle
+		struct Pair
+		{
+			std::shared_ptr<Root> a;
+			std::shared_ptr<Root> b;
+
+			emap(eref(a), eref(b))
+		};
+
+		Pair pair { root, root };
+		CHECK_NOTHROW(make_vref(pair).encode(c, dst, "a", stack));
 	}
 }
 
@@ -632,3 +653,86 @@ TEST_CASE_TEMPLATE("vref can map to unique pointers of encodable types", T, bool
 }
 
 
+struct SharedNode
+{
+	string name;
+	std::shared_ptr<SharedNode> next;
+
+	emap(eref(name), eref(next))
+};
+
+
+struct SharedGraph
+{
+	std::vector<std::shared_ptr<SharedNode>> nodes;
+	std::shared_ptr<int> value;
+	std::shared_ptr<int> same;
+
+	emap(eref(nodes), eref(value), eref(same))
+};
+
+
+struct AliasedGraph
+{
+	std::shared_ptr<SharedNode> node;
+	std::shared_ptr<string> name;
+
+	emap(eref(node), eref(name))
+};
+
+
+TEST_CASE_TEMPLATE("shared pointers can be tracked to preserve their identity", C, json, bson, compact)
+{
+	auto shared = std::make_shared<SharedNode>(SharedNode { string(200, 's'), nullptr });
+	SharedGraph graph;
+
+	graph.nodes = { shared, shared, std::make_shared<SharedNode>(SharedNode { "other", shared }) };
+	graph.value	= std::make_shared<int>(42);
+	graph.same	= graph.value;
+
+	SUBCASE("each shared object is written once")
+	{
+		const auto data = encode<tracked<C>>(graph);
+
+		CHECK(data.size() < encode<C>(graph).size());
+
+		auto result = decode<tracked<C>, SharedGraph>(data);
+
+		REQUIRE(result.nodes.size() == 3);
+		CHECK(result.nodes[0]->name		== shared->name);
+		CHECK(result.nodes[0]			== result.nodes[1]);
+		CHECK(result.nodes[2]->next		== result.nodes[0]);
+		CHECK(result.nodes[2]->name		== "other");
+		CHECK(*result.value				== 42);
+		CHECK(result.value				== result.same);
+	}
+
+	SUBCASE("circular references can be restored")
+	{
+		shared->next = shared;
+
+		CHECK_THROWS(encode<C>(graph));
+
+		auto result = decode<tracked<C>, SharedGraph>(encode<tracked<C>>(graph));
+
+		CHECK(result.nodes[0]->next == result.nodes[0]);
+
+		// Break the cycles so that the objects are released
+		shared->next			= nullptr;
+		result.nodes[0]->next	= nullptr;
+	}
+
+	SUBCASE("aliasing pointers to a different type at the same address are distinct")
+	{
+		AliasedGraph aliased;
+		aliased.node = shared;
+		aliased.name = std::shared_ptr<string>(shared, &shared->name);
+
+		REQUIRE((void *)aliased.name.get() == (void *)aliased.node.get());
+
+		auto result = decode<tracked<C>, AliasedGraph>(encode<tracked<C>>(aliased));
+
+		CHECK(result.node->name	== shared->name);
+		CHECK(*result.name		== shared->name);
+	}
+}